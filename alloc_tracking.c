@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef TRACK_ALLOCATIONS
+
+/* the real allocator, the macros aren't defined yet */
+#include "alloc_tracking.h"
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+typedef struct {
+    char *name;
+    unsigned long number_of_allocations;
+    unsigned long bytes; /* allocated in total */
+    unsigned long live_bytes;
+    unsigned long peak_bytes; /* high-water mark of live_bytes */
+} subsystem_stats;
+
+/* kept in front of every allocation, aligned for anything that follows it */
+typedef union {
+    struct {
+        size_t size;
+        unsigned int subsystem;
+    } info;
+    double align_double;
+    long align_long;
+    void *align_pointer;
+} allocation_header;
+
+/* the pipeline frees on its writer thread */
+pthread_mutex_t tracking_lock = PTHREAD_MUTEX_INITIALIZER;
+subsystem_stats subsystems[MAX_TRACKED_SUBSYSTEMS];
+unsigned int number_of_subsystems;
+unsigned long total_live_bytes, total_peak_bytes;
+
+/* index of the subsystem, adding it if new. call with the lock held */
+unsigned int find_subsystem(char *name)
+{
+    unsigned int i;
+    for(i = 0; i < number_of_subsystems; i++)
+    {
+        if(!strcmp(subsystems[i].name, name))
+            return i;
+    }
+    if(number_of_subsystems == MAX_TRACKED_SUBSYSTEMS)
+        return MAX_TRACKED_SUBSYSTEMS - 1;
+    subsystems[number_of_subsystems].name = name;
+    return number_of_subsystems++;
+}
+
+/* count a new block of size bytes */
+void track_allocation(allocation_header *header, size_t size, char *name)
+{
+    subsystem_stats *stats;
+
+    pthread_mutex_lock(&tracking_lock);
+    header->info.size = size;
+    header->info.subsystem = find_subsystem(name);
+    stats = subsystems + header->info.subsystem;
+    stats->number_of_allocations++;
+    stats->bytes += size;
+    if((stats->live_bytes += size) > stats->peak_bytes)
+        stats->peak_bytes = stats->live_bytes;
+    if((total_live_bytes += size) > total_peak_bytes)
+        total_peak_bytes = total_live_bytes;
+    pthread_mutex_unlock(&tracking_lock);
+}
+
+/* uncount a block, on the subsystem which allocated it */
+void track_free(allocation_header *header)
+{
+    pthread_mutex_lock(&tracking_lock);
+    subsystems[header->info.subsystem].live_bytes -= header->info.size;
+    total_live_bytes -= header->info.size;
+    pthread_mutex_unlock(&tracking_lock);
+}
+
+void *tracked_malloc(size_t size, char *subsystem)
+{
+    allocation_header *header = malloc(sizeof(allocation_header) + size);
+    if(!header)
+        return NULL;
+    track_allocation(header, size, subsystem);
+    return header + 1;
+}
+
+void *tracked_calloc(size_t n, size_t size, char *subsystem)
+{
+    void *ptr;
+    if(size && n > ((size_t)-1 - sizeof(allocation_header)) / size)
+        return NULL;
+    if((ptr = tracked_malloc(n * size, subsystem)))
+        memset(ptr, 0, n * size);
+    return ptr;
+}
+
+void *tracked_realloc(void *ptr, size_t size, char *subsystem)
+{
+    allocation_header *header;
+
+    if(!ptr)
+        return tracked_malloc(size, subsystem);
+
+    /* on failure the old block is untouched, and still counted */
+    if(!(header = realloc((allocation_header *)ptr - 1, sizeof(allocation_header) + size)))
+        return NULL;
+
+    /* counted as a free of the old block and an allocation of the new one, the header was copied */
+    track_free(header);
+    track_allocation(header, size, subsystems[header->info.subsystem].name);
+    return header + 1;
+}
+
+void tracked_free(void *ptr)
+{
+    allocation_header *header;
+    if(!ptr)
+        return;
+    header = (allocation_header *)ptr - 1;
+    track_free(header);
+    free(header);
+}
+
+/* start measuring peaks from what's live now */
+void reset_allocation_peaks(void)
+{
+    unsigned int i;
+    pthread_mutex_lock(&tracking_lock);
+    for(i = 0; i < number_of_subsystems; i++)
+    {
+        subsystems[i].peak_bytes = subsystems[i].live_bytes;
+        subsystems[i].number_of_allocations = subsystems[i].bytes = 0;
+    }
+    total_peak_bytes = total_live_bytes;
+    pthread_mutex_unlock(&tracking_lock);
+}
+
+/* print what each subsystem allocated since reset_allocation_peaks, and the peak per source line */
+void print_allocation_summary(char *file_path, unsigned int number_of_lines)
+{
+    unsigned int i;
+    double lines = number_of_lines ? number_of_lines : 1;
+
+    pthread_mutex_lock(&tracking_lock);
+    printf(">> Allocations for \"%s\"(%u lines):\n", file_path, number_of_lines);
+    printf("   %-22s %10s %12s %12s %12s %10s\n", "subsystem", "count", "bytes", "live", "peak", "peak/line");
+    for(i = 0; i < number_of_subsystems; i++)
+    {
+        if(subsystems[i].number_of_allocations || subsystems[i].live_bytes)
+            printf("   %-22s %10lu %12lu %12lu %12lu %10.1f\n", subsystems[i].name, subsystems[i].number_of_allocations,
+                   subsystems[i].bytes, subsystems[i].live_bytes, subsystems[i].peak_bytes, subsystems[i].peak_bytes / lines);
+    }
+    printf("   %-22s %10s %12s %12lu %12lu %10.1f\n", "total", "", "", total_live_bytes, total_peak_bytes, total_peak_bytes / lines);
+    pthread_mutex_unlock(&tracking_lock);
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _ALLOC_TRACKING_H
+#define _ALLOC_TRACKING_H
+
+/*
+ * compile everything with -DTRACK_ALLOCATIONS to count the heap used by each source file(subsystem).
+ * include this header after all the system headers, so every allocation and free goes through the
+ * tracker, whichever file frees it.
+ */
+#ifdef TRACK_ALLOCATIONS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* maximum number of subsystems tracked, allocations of any more are counted on the last one */
+#define MAX_TRACKED_SUBSYSTEMS 32
+
+void *tracked_malloc(size_t size, char *subsystem);
+void *tracked_calloc(size_t n, size_t size, char *subsystem);
+void *tracked_realloc(void *ptr, size_t size, char *subsystem);
+void tracked_free(void *ptr);
+void reset_allocation_peaks(void);
+void print_allocation_summary(char *file_path, unsigned int number_of_lines);
+
+#define malloc(size) tracked_malloc((size), __FILE__)
+#define calloc(n, size) tracked_calloc((n), (size), __FILE__)
+#define realloc(ptr, size) tracked_realloc((ptr), (size), __FILE__)
+#define free(ptr) tracked_free(ptr)
+
+#endif
+
+#endif
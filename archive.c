@@ -0,0 +1,402 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+#include "utilities.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/*
+ * for a lot of tiny sources, opening and closing a file or four for each of them costs more than assembling it.
+ * in batch mode the sources come from a single tar archive, which is mapped and read from memory,
+ * and the output files are kept in memory until they're closed and then appended to a single output tar
+ * archive with large sequential writes. the last member of the output archive lists where all the others are.
+ */
+
+/* offsets of the fields of a tar header */
+#define TAR_NAME 0
+#define TAR_NAME_LEN 100
+#define TAR_MODE 100
+#define TAR_UID 108
+#define TAR_GID 116
+#define TAR_SIZE 124
+#define TAR_MTIME 136
+#define TAR_CHECKSUM 148
+#define TAR_TYPE 156
+#define TAR_MAGIC 257
+#define TAR_VERSION 263
+#define TAR_PREFIX 345
+#define TAR_PREFIX_LEN 155
+
+/* a source in the mapping of the input archive */
+typedef struct {
+    char *path; /* without the .as extension */
+    char *text;
+    unsigned long size;
+} archive_source;
+
+/* a member written to the output archive */
+typedef struct {
+    char *name;
+    unsigned long offset; /* of its data */
+    unsigned long size;
+} archive_member;
+
+typedef struct {
+    unsigned int open:1;
+    char *map;
+    unsigned long map_size;
+    archive_source *sources;
+    int number_of_sources;
+    int number_of_opened; /* sources taken by the assembler, in order */
+
+    FILE *out;
+    char out_buffer[ARCHIVE_WRITE_BUFFER_SIZE];
+    unsigned long out_offset;
+    unsigned long mtime;
+    archive_member *members;
+    unsigned long number_of_members;
+    unsigned long members_capacity;
+
+    FILE *output; /* the output file being written, in memory */
+    char output_name[MAX_FILE_PATH];
+    char *output_text;
+    size_t output_size;
+} archive_state;
+
+archive_state archive;
+
+/* copy a header field, which is null terminated only if it's shorter than len. returns its length */
+unsigned int copy_tar_field(char *dst, char *field, unsigned int len)
+{
+    unsigned int i;
+    for(i = 0; i < len && field[i]; i++)
+        dst[i] = field[i];
+    dst[i] = '\x0';
+    return i;
+}
+
+/* returns the value of an octal header field, -1 if it isn't one */
+long read_tar_number(char *field, unsigned int len)
+{
+    unsigned int i = 0;
+    long val = 0;
+
+    while(i < len && field[i] == ' ')
+        i++;
+    if(i == len || field[i] < '0' || field[i] > '7')
+        return -1;
+    for(; i < len && field[i] >= '0' && field[i] <= '7'; i++)
+        val = val * 8 + field[i] - '0';
+    return i == len || !field[i] || field[i] == ' ' ? val : -1;
+}
+
+/* returns the checksum of a header, the sum of its bytes with the checksum field taken as spaces */
+long tar_checksum(char *header)
+{
+    long sum = 0;
+    int i;
+
+    for(i = 0; i < TAR_BLOCK_SIZE; i++)
+        sum += i >= TAR_CHECKSUM && i < TAR_CHECKSUM + 8 ? ' ' : (unsigned char)header[i];
+    return sum;
+}
+
+/* add the member named name to the sources if it's one. returns SUCCESS on success, error code otherwise */
+int add_archive_source(char *name, char *text, unsigned long size)
+{
+    archive_source *sources;
+    size_t len = strlen(name);
+
+    if(len <= 3 || strcmp(name + len - 3, ".as"))
+        return SUCCESS;
+
+    /* the sources are counted as they're found, grow the array in powers of two */
+    if(!(archive.number_of_sources & (archive.number_of_sources - 1)))
+    {
+        if(!(sources = realloc(archive.sources, (archive.number_of_sources ? archive.number_of_sources * 2 : 1) * sizeof(archive_source))))
+            return ERR_MEM_ALLOC_FAILED;
+        archive.sources = sources;
+    }
+    if(!(archive.sources[archive.number_of_sources].path = malloc(len - 2)))
+        return ERR_MEM_ALLOC_FAILED;
+    memcpy(archive.sources[archive.number_of_sources].path, name, len - 3);
+    archive.sources[archive.number_of_sources].path[len - 3] = '\x0';
+    archive.sources[archive.number_of_sources].text = text;
+    archive.sources[archive.number_of_sources++].size = size;
+    return SUCCESS;
+}
+
+/* find the sources among the members of the mapped archive. returns SUCCESS on success, error code otherwise */
+int index_archive_sources(void)
+{
+    char name[MAX_FILE_PATH], *header, *long_name = NULL;
+    unsigned long offset = 0, data, len;
+    long size;
+    int res;
+
+    /* the archive ends with empty blocks, or just ends */
+    for(; offset + TAR_BLOCK_SIZE <= archive.map_size && archive.map[offset]; offset = data + (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE)
+    {
+        header = archive.map + offset;
+        data = offset + TAR_BLOCK_SIZE;
+        if(read_tar_number(header + TAR_CHECKSUM, 8) != tar_checksum(header) || (size = read_tar_number(header + TAR_SIZE, 12)) < 0 ||
+           (unsigned long)size > archive.map_size - data)
+            return ERR_INVALID_ARCHIVE;
+
+        /* gnu tar puts a long name in a member of its own, right before the member it belongs to */
+        if(header[TAR_TYPE] == 'L')
+        {
+            long_name = archive.map + data;
+            len = size;
+            continue;
+        }
+
+        /* only regular files can be sources */
+        if(header[TAR_TYPE] == '0' || !header[TAR_TYPE])
+        {
+            if(long_name)
+            {
+                if(len >= MAX_FILE_PATH)
+                    return ERR_INVALID_ARCHIVE;
+                copy_tar_field(name, long_name, len);
+            }
+            else if(!memcmp(header + TAR_MAGIC, "ustar", 5) && header[TAR_PREFIX])
+            {
+                len = copy_tar_field(name, header + TAR_PREFIX, TAR_PREFIX_LEN);
+                name[len++] = '/';
+                copy_tar_field(name + len, header + TAR_NAME, TAR_NAME_LEN);
+            }
+            else
+            {
+                copy_tar_field(name, header + TAR_NAME, TAR_NAME_LEN);
+            }
+
+            if((res = add_archive_source(name, archive.map + data, size)) != SUCCESS)
+                return res;
+        }
+        long_name = NULL;
+    }
+    return SUCCESS;
+}
+
+/* map the tar archive of the sources and create the output archive.
+ * returns the number of sources on success, error code otherwise */
+int open_archive(char *archive_path, char *output_path)
+{
+    struct stat st;
+    int fd, res = ERR_COULD_NOT_OPEN_FILE;
+
+    if((fd = open(archive_path, O_RDONLY)) < 0)
+        return res;
+    if(fstat(fd, &st) == 0)
+    {
+        archive.map_size = st.st_size;
+
+        /* a tar archive is made of whole blocks */
+        if(!archive.map_size || archive.map_size % TAR_BLOCK_SIZE)
+            res = ERR_INVALID_ARCHIVE;
+        else if((archive.map = mmap(NULL, archive.map_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+            archive.map = NULL;
+        else
+            res = SUCCESS;
+    }
+    close(fd);
+
+    if(res == SUCCESS)
+    {
+        posix_madvise(archive.map, archive.map_size, POSIX_MADV_SEQUENTIAL);
+        if((res = index_archive_sources()) == SUCCESS && !(archive.out = fopen(output_path, "wb")))
+            res = ERR_COULD_NOT_OPEN_FILE;
+    }
+    if(res != SUCCESS)
+    {
+        archive.open = 1;
+        archive.out = NULL;
+        close_archive();
+        return res;
+    }
+
+    setvbuf(archive.out, archive.out_buffer, _IOFBF, ARCHIVE_WRITE_BUFFER_SIZE);
+    archive.mtime = time(NULL);
+    archive.open = 1;
+    return archive.number_of_sources;
+}
+
+/* returns the path(without the .as extension) of the i-th source in the archive */
+char *get_archive_source_path(int i)
+{
+    return archive.sources[i].path;
+}
+
+/* open the next source of the archive if it's filename, from the mapping. returns NULL if it isn't */
+FILE *open_archive_source(char *filename)
+{
+    static char empty_source[] = "\n";
+    archive_source *source;
+    size_t len;
+
+    if(!archive.open || archive.number_of_opened == archive.number_of_sources)
+        return NULL;
+
+    source = archive.sources + archive.number_of_opened;
+    len = strlen(source->path);
+    if(strncmp(filename, source->path, len) || strcmp(filename + len, ".as"))
+        return NULL;
+    archive.number_of_opened++;
+
+    /* an empty buffer can't be opened as a stream, an empty line is the same as no lines */
+    if(!source->size)
+        return fmemopen(empty_source, 1, "r");
+    return fmemopen(source->text, source->size, "r");
+}
+
+/* write a header of a regular file member. returns SUCCESS on success, error code otherwise */
+int write_tar_header(char *name, unsigned long size)
+{
+    char header[TAR_BLOCK_SIZE], *sep;
+    size_t len = strlen(name);
+
+    memset(header, 0, TAR_BLOCK_SIZE);
+    if(len <= TAR_NAME_LEN)
+    {
+        memcpy(header + TAR_NAME, name, len);
+    }
+    else
+    {
+        /* a longer name is split at a '/' into the prefix and the name */
+        for(sep = name + len - TAR_NAME_LEN - 1; *sep && *sep != '/'; sep++);
+        if(!*sep || sep == name || sep - name > TAR_PREFIX_LEN)
+            return ERR_INVALID_ARCHIVE;
+        memcpy(header + TAR_PREFIX, name, sep - name);
+        memcpy(header + TAR_NAME, sep + 1, len - (sep - name) - 1);
+    }
+
+    sprintf(header + TAR_MODE, "%07o", 0644);
+    sprintf(header + TAR_UID, "%07o", 0);
+    sprintf(header + TAR_GID, "%07o", 0);
+    sprintf(header + TAR_SIZE, "%011lo", size);
+    sprintf(header + TAR_MTIME, "%011lo", archive.mtime);
+    header[TAR_TYPE] = '0';
+    memcpy(header + TAR_MAGIC, "ustar", 6);
+    memcpy(header + TAR_VERSION, "00", 2);
+
+    /* six digits, a null and a space */
+    sprintf(header + TAR_CHECKSUM, "%06lo", tar_checksum(header));
+    header[TAR_CHECKSUM + 7] = ' ';
+    return fwrite(header, 1, TAR_BLOCK_SIZE, archive.out) == TAR_BLOCK_SIZE ? SUCCESS : ERR_COULD_NOT_OPEN_FILE;
+}
+
+/* append a member to the output archive and to its index. returns SUCCESS on success, error code otherwise */
+int write_archive_member(char *name, char *text, unsigned long size)
+{
+    static const char padding[TAR_BLOCK_SIZE];
+    archive_member *members;
+    unsigned long padding_size = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    int res;
+
+    if(archive.number_of_members == archive.members_capacity)
+    {
+        archive.members_capacity = archive.members_capacity ? archive.members_capacity * 2 : 64;
+        if(!(members = realloc(archive.members, archive.members_capacity * sizeof(archive_member))))
+            return ERR_MEM_ALLOC_FAILED;
+        archive.members = members;
+    }
+    if(!(archive.members[archive.number_of_members].name = malloc(strlen(name) + 1)))
+        return ERR_MEM_ALLOC_FAILED;
+    strcpy(archive.members[archive.number_of_members].name, name);
+    archive.members[archive.number_of_members].offset = archive.out_offset + TAR_BLOCK_SIZE;
+    archive.members[archive.number_of_members++].size = size;
+
+    if((res = write_tar_header(name, size)) != SUCCESS)
+        return res;
+    if(fwrite(text, 1, size, archive.out) != size || fwrite(padding, 1, padding_size, archive.out) != padding_size)
+        return ERR_COULD_NOT_OPEN_FILE;
+    archive.out_offset += TAR_BLOCK_SIZE + size + padding_size;
+    return SUCCESS;
+}
+
+/* open an output file for writing, in memory if it goes to the archive. returns NULL on failure */
+FILE *open_output_file(char *name, char *mode)
+{
+    if(!archive.open)
+        return fopen(name, mode);
+
+    /* the writers write one file at a time */
+    if(archive.output)
+        return NULL;
+    strcpy(archive.output_name, name);
+    return archive.output = open_memstream(&archive.output_text, &archive.output_size);
+}
+
+/* close an output file opened by open_output_file, appending it to the archive if it goes there. returns 0 on success, EOF otherwise */
+int close_output_file(FILE *fh)
+{
+    int res;
+
+    if(!archive.output || fh != archive.output)
+        return fclose(fh);
+
+    archive.output = NULL;
+    if((res = fclose(fh)) == 0 && write_archive_member(archive.output_name, archive.output_text, archive.output_size) != SUCCESS)
+        res = EOF;
+
+    /* the stream's buffer comes from the c library, it isn't tracked */
+    (free)(archive.output_text);
+    return res;
+}
+
+/* write the index and the end of the output archive, and free everything. returns SUCCESS on success, error code otherwise */
+int close_archive(void)
+{
+    static const char end_of_archive[2 * TAR_BLOCK_SIZE];
+    char *index_text = NULL;
+    size_t index_size = 0;
+    FILE *fh;
+    unsigned long i;
+    int res = SUCCESS;
+
+    if(!archive.open)
+        return SUCCESS;
+
+    if(archive.out)
+    {
+        /* "name offset size" of each member, the offset of its data from the start of the archive */
+        if(!(fh = open_memstream(&index_text, &index_size)))
+        {
+            res = ERR_MEM_ALLOC_FAILED;
+        }
+        else
+        {
+            for(i = 0; i < archive.number_of_members; i++)
+                fprintf(fh, "%s %lu %lu\n", archive.members[i].name, archive.members[i].offset, archive.members[i].size);
+            if(fclose(fh) != 0)
+                res = ERR_MEM_ALLOC_FAILED;
+            else if((res = write_archive_member(ARCHIVE_INDEX_NAME, index_text, index_size)) == SUCCESS &&
+                    fwrite(end_of_archive, 1, sizeof(end_of_archive), archive.out) != sizeof(end_of_archive))
+                res = ERR_COULD_NOT_OPEN_FILE;
+            (free)(index_text);
+        }
+        if(fclose(archive.out) != 0)
+            res = ERR_COULD_NOT_OPEN_FILE;
+    }
+
+    if(archive.map)
+        munmap(archive.map, archive.map_size);
+    for(i = 0; i < (unsigned long)archive.number_of_sources; i++)
+        free(archive.sources[i].path);
+    free(archive.sources);
+    for(i = 0; i < archive.number_of_members; i++)
+        free(archive.members[i].name);
+    free(archive.members);
+    memset(&archive, 0, sizeof(archive));
+    return res;
+}
@@ -0,0 +1,22 @@
+#ifndef _ARCHIVE_H
+#define _ARCHIVE_H
+
+#include <stdio.h>
+
+/* size of the tar blocks, both the headers and the padded data of the members */
+#define TAR_BLOCK_SIZE 512
+
+/* stdio buffer of the output archive, so it's written in large sequential chunks */
+#define ARCHIVE_WRITE_BUFFER_SIZE (1 << 20)
+
+/* name of the last member of the output archive, listing where all the others are */
+#define ARCHIVE_INDEX_NAME "index"
+
+int open_archive(char *archive_path, char *output_path);
+char *get_archive_source_path(int i);
+FILE *open_archive_source(char *filename);
+FILE *open_output_file(char *name, char *mode);
+int close_output_file(FILE *fh);
+int close_archive(void);
+
+#endif
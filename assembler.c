@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include "first_pass.h"
 #include "second_pass.h"
@@ -8,37 +9,142 @@
 #include "errors.h"
 #include "externals.h"
 #include "utilities.h"
+#include "options.h"
+#include "assembler.h"
+#include "watch.h"
+#include "incremental.h"
+#include "optimizer.h"
+#include "gc.h"
+#include "merge_data.h"
+#include "xref.h"
+#include "compressed_object.h"
+#include "stream.h"
+#include "pipeline.h"
+#include "check.h"
+#include "mapped_object.h"
+#include "include.h"
+#include "trace.h"
+#include "encoding_cache.h"
+#include "relocations.h"
+#include "disassembler.h"
+#include "archive.h"
+#include "alloc_tracking.h"
 
-/* write all the output(object, externals & entries) files */
+/* everything the output files are made of, owned by whoever writes them */
+typedef struct {
+    char file_path[MAX_FILE_PATH];
+    memory_segment code_segment;
+    memory_segment data_segment;
+    symbol_table symbols;
+    externals_table external_symbols;
+    spill_files spills;
+} assembled_file;
+
+/* write all the output(object, externals, entries & the optional ones) files, the words are in spills when streaming */
 void write_output_files(char *original_file_path,
                        memory_segment *code_segment,
                        memory_segment *data_segment,
                        symbol_table *symbols,
-                       list *external_symbols)
+                       list *external_symbols,
+                       spill_files *spills)
 {
     int res;
 
+    TRACE_BEGIN("write_output_files", original_file_path);
+
     /* write the machine code to file */
-    res = write_object_file(original_file_path, code_segment, data_segment);
+    TRACE_BEGIN("write_object_file", NULL);
+    if(options.low_memory)
+        res = write_streamed_object_file(original_file_path, spills, code_segment, data_segment);
+    else if(options.compress)
+        res = write_compressed_object_file(original_file_path, code_segment, data_segment);
+    else if(options.threads)
+        res = write_mapped_object_file(original_file_path, code_segment, data_segment, options.threads);
+    else
+        res = write_object_file(original_file_path, code_segment, data_segment);
+    TRACE_END("write_object_file");
     if(res < 0)
         printf("ERROR! failed to create object file for \"%s\"\n", original_file_path);
 
     if(!is_symbols_table_empty(symbols))
     {
+        TRACE_BEGIN("write_entries_file", NULL);
         res = write_entries_file(symbols, original_file_path);
-        if(res == 0)
+        TRACE_END("write_entries_file");
+        if(res < 0)
             printf("ERROR! failed to create entries file for \"%s\"\n", original_file_path);
     }
 
     /* write externals to file(if any) */
     if(!is_empty(external_symbols))
     {
+        TRACE_BEGIN("write_externals_file", NULL);
         res = write_externals_file(original_file_path, external_symbols);
+        TRACE_END("write_externals_file");
         if(res == 0)
             printf("ERROR! failed to create externals file for \"%s\"\n", original_file_path);
     }
+
+    /* write the words a loader has to move along with the image if asked to */
+    if(options.relocations)
+    {
+        TRACE_BEGIN("write_relocations_file", NULL);
+        if(write_relocations_file(original_file_path, code_segment, data_segment, symbols) < 0)
+            printf("ERROR! failed to create relocations file for \"%s\"\n", original_file_path);
+        TRACE_END("write_relocations_file");
+    }
+
+    /* write the cross reference index if asked to */
+    if(options.xref)
+    {
+        TRACE_BEGIN("write_xref_file", NULL);
+        if(write_xref_file(original_file_path, symbols) != SUCCESS)
+            printf("ERROR! failed to create cross reference file for \"%s\"\n", original_file_path);
+        TRACE_END("write_xref_file");
+    }
+    TRACE_END("write_output_files");
+}
+
+/* free everything the assembly of a file created */
+void free_assembly(memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, externals_table *external_symbols, spill_files *spills)
+{
+    free_memory_segment(code_segment);
+    free_memory_segment(data_segment);
+    free_symbols_table(symbols);
+    free_externals_table(external_symbols);
+    close_spill_files(spills);
+}
+
+/* write the output files of an assembled file and free it, called by the pipeline */
+void write_assembled_file(void *data)
+{
+    assembled_file *assembled = (assembled_file *)data;
+
+    write_output_files(assembled->file_path, &assembled->code_segment, &assembled->data_segment,
+                       &assembled->symbols, &assembled->external_symbols, &assembled->spills);
+    free_assembly(&assembled->code_segment, &assembled->data_segment, &assembled->symbols,
+                  &assembled->external_symbols, &assembled->spills);
+    free(assembled);
 }
 
+#ifdef TRACK_ALLOCATIONS
+/* number of lines in the file, for the allocations summary */
+unsigned int count_lines(FILE *fh)
+{
+    unsigned int number_of_lines = 0;
+    int c, last = '\n';
+
+    rewind(fh);
+    while((c = getc(fh)) != EOF)
+    {
+        if(c == '\n')
+            number_of_lines++;
+        last = c;
+    }
+    return number_of_lines + (last != '\n');
+}
+#endif
+
 /* assemble a single input file */
 void assemble(char *file_path)
 {
@@ -48,6 +154,9 @@ void assemble(char *file_path)
     memory_segment code_segment, data_segment;
     symbol_table symbols;
     externals_table external_symbols;
+    incremental_state state;
+    spill_files spills = {NULL, NULL};
+    assembled_file *assembled = NULL;
     int number_of_errors;
 
     /* add '.as' type to filename */
@@ -61,6 +170,16 @@ void assemble(char *file_path)
         printf("ERROR! file path is too long! max is %d!\n", MAX_FILE_PATH);
         return;
     }
+
+    /* only look for errors, without encoding or writing anything */
+    if(options.check)
+    {
+        TRACE_BEGIN("check_file", filename);
+        check_file(filename);
+        TRACE_END("check_file");
+        return;
+    }
+    TRACE_BEGIN("assemble", filename);
     
     /* initialize memory segments with base IC 100 and base DC 0 */
     init_memory_segment(&code_segment, 100);
@@ -68,71 +187,239 @@ void assemble(char *file_path)
 
     /* initialize the symbols table */
     init_symbol_table(&symbols);
+    set_symbols_base_address(&symbols, code, code_segment.base_address);
 
     /* initialize the list for external symbols (which we might find on the second pass) */
     init_externals_table(&external_symbols);
         
-    /* try to open input file if specified by the user */
-    fh = fopen(filename, "r");
+    /* try to open input file if specified by the user, from the archive if it's the next source in it */
+    if(!(fh = open_archive_source(filename)))
+        fh = pipeline_open_source(filename);
     if (fh)
     {
         /* print current filename */
         printf(">> Assembling \"%s\"...\n", filename);
+#ifdef TRACK_ALLOCATIONS
+        reset_allocation_peaks();
+#endif
+
+        /* start the first pass, reusing the previous run encoding if asked to */
+        TRACE_BEGIN("first_pass", NULL);
+        reset_encoding_cache_stats();
+        if(options.low_memory)
+            number_of_errors = stream_first_pass(fh, &code_segment, &data_segment, &symbols);
+        else if(options.incremental)
+            number_of_errors = incremental_first_pass(&state, file_path, fh, &code_segment, &data_segment, &symbols);
+        else
+            number_of_errors = first_pass(fh, &code_segment, &data_segment, &symbols);
+        TRACE_END("first_pass");
+        if(options.stats)
+            print_encoding_cache_stats(filename);
 
-        /* start the first pass */
-        number_of_errors = first_pass(fh, &code_segment, &data_segment, &symbols);
+        /* remove redundant instructions before any address is final */
+        if(options.optimize && !number_of_errors)
+        {
+            TRACE_BEGIN("optimize_code_segment", NULL);
+            printf(">> Optimizer removed %u words\n", optimize_code_segment(&code_segment, &symbols));
+            TRACE_END("optimize_code_segment");
+        }
+
+        /* drop code and data nobody can reach, before any address is final */
+        if(options.gc_sections && !number_of_errors)
+        {
+            TRACE_BEGIN("collect_unreachable_items", NULL);
+            if((res = collect_unreachable_items(fh, &code_segment, &data_segment, &symbols, options.gc_start_label)) >= 0)
+                printf(">> Removed %d unreachable words\n", res);
+            else
+                printf(">> Nothing removed: %s\n", error_code_to_string(res));
+            TRACE_END("collect_unreachable_items");
+        }
+
+        /* keep a single copy of repeated data, before any data address is final */
+        if(options.merge_data && !number_of_errors)
+        {
+            TRACE_BEGIN("merge_data_segment", NULL);
+            printf(">> Data merging removed %u words\n", merge_data_segment(&data_segment, &symbols));
+            TRACE_END("merge_data_segment");
+        }
 
         /* calculate were data segment should start */
+        TRACE_BEGIN("set_symbols_base_address", NULL);
         res = size_of_segment(&code_segment) + code_segment.base_address;
 
-        /* updated symbols and data addresses according to the final size of the code segment */
-        update_symbols_addresses(&symbols, data, res);
+        /* data symbols and addresses follow the final size of the code segment */
+        set_symbols_base_address(&symbols, data, res);
         data_segment.base_address = res;
+        TRACE_END("set_symbols_base_address");
+        TRACE_COUNTER("symbols", list_length(&symbols.symbols));
+        TRACE_COUNTER("words", res - code_segment.base_address + size_of_segment(&data_segment));
+
+        TRACE_BEGIN("second_pass", NULL);
 
-        /* set the file pointer back to start */
-        rewind(fh);
+        if(options.incremental)
+        {
+            /* the incremental first pass keeps the lines, no need to read the file again */
+            number_of_errors += incremental_second_pass(&state, &code_segment, &data_segment, &symbols, &external_symbols);
+        }
+        else if(options.low_memory)
+        {
+            rewind(fh);
+
+            /* encode every line again, straight to the spill files */
+            if(open_spill_files(&spills) == SUCCESS)
+            {
+                number_of_errors += stream_second_pass(fh, &spills, &code_segment, &data_segment, &symbols, &external_symbols);
+            }
+            else
+            {
+                printf("ERROR! could not create spill files for \"%s\"\n", filename);
+                number_of_errors++;
+            }
+        }
+        else
+        {
+            /* set the file pointer back to start */
+            rewind(fh);
 
-        /* start the second pass */
-        number_of_errors += second_pass(fh, &code_segment, &data_segment, &symbols, &external_symbols);
+            /* start the second pass */
+            number_of_errors += second_pass(fh, &code_segment, &data_segment, &symbols, &external_symbols);
+        }
+        TRACE_END("second_pass");
 
         /* only create the files if no errors */
         if(!number_of_errors)
         {
-            write_output_files(file_path, &code_segment, &data_segment, &symbols,  &external_symbols);
+            /* keep this run's state for the next one, the output files take over the segments */
+            if(options.incremental && save_incremental_state(&state, file_path, &code_segment, &data_segment, &symbols) != SUCCESS)
+                printf("ERROR! failed to save incremental state for \"%s\"\n", file_path);
+
+            /* the pipeline writes them in the background, while the next file is assembled */
+            if((assembled = malloc(sizeof(assembled_file))))
+            {
+                strcpy(assembled->file_path, file_path);
+                assembled->code_segment = code_segment;
+                assembled->data_segment = data_segment;
+                assembled->symbols = symbols;
+                assembled->external_symbols = external_symbols;
+                assembled->spills = spills;
+                pipeline_write(write_assembled_file, assembled);
+            }
+            else
+            {
+                write_output_files(file_path, &code_segment, &data_segment, &symbols,  &external_symbols, &spills);
+            }
             puts(">> No errors... writing to disk...");
+
+            if(options.incremental)
+                printf(">> Reused %u of %u lines\n", state.number_of_reused_lines, state.current.number_of_lines);
         }
         else
         {
             printf(">> %s found, quitting...\n", res > 1 ? "Errors" : "Error");
         }
 
-        /* free everything */
-        free_memory_segment(&code_segment);
-        free_memory_segment(&data_segment);
-        free_symbols_table(&symbols);
-        free_externals_table(&external_symbols);
+        /* free everything(unless the output files own it now) */
+        if(!assembled)
+            free_assembly(&code_segment, &data_segment, &symbols, &external_symbols, &spills);
+        if(options.incremental)
+            free_incremental_state(&state);
+
+#ifdef TRACK_ALLOCATIONS
+        print_allocation_summary(filename, count_lines(fh));
+#endif
 
         /* close the file */
-        fclose(fh);
+        pipeline_close_source(fh);
     }
     else
     {
         printf("ERROR! could not open file \"%s\"\n", filename);
     }
+    TRACE_END("assemble");
 }
 
 /* parse command line and assemble files */
 int main(int argc, char *argv[])
 {
-    int i;
+    int i, res, number_of_files, number_of_sources = 0;
+    unsigned long val, address, line;
+    char **files;
+
+    if(!(files = malloc(argc * sizeof(char *))))
+    {
+        printf("ERROR! %s\n", error_code_to_string(ERR_MEM_ALLOC_FAILED));
+        return 0;
+    }
+
+    /* read the options, everything else is a file to assemble */
+    number_of_files = parse_options(argc, argv, files);
 
-    /* assemble all the files in argv */
-    for(i = 1; i < argc; i++)
+    /* record the timeline of the run if asked to */
+    if(options.trace_path && start_trace() != SUCCESS)
+        printf("ERROR! %s\n", error_code_to_string(ERR_MEM_ALLOC_FAILED));
+
+    /* assemble the sources of the archive first, the output files of everything go into the output archive */
+    if(options.archive_path && number_of_files >= 0 && (number_of_sources = open_archive(options.archive_path, options.archive_output_path)) < 0)
+        printf("ERROR! could not open archive \"%s\": %s\n", options.archive_path, error_code_to_string(number_of_sources));
+    for(i = 0; i < number_of_sources; i++)
+        assemble(get_archive_source_path(i));
+
+    /* assemble all the files, reading and writing in the background if asked to */
+    if(options.pipeline)
+        start_pipeline(files, number_of_files);
+    for(i = 0; i < number_of_files; i++)
+    {
+        assemble(files[i]);
+    }
+    stop_pipeline();
+
+    if(number_of_sources >= 0 && close_archive() != SUCCESS)
+        printf("ERROR! could not write archive \"%s\"\n", options.archive_output_path);
+
+    /* the timeline covers the first build only, --watch rebuilds aren't recorded */
+    if(tracing && write_trace_file(options.trace_path) != SUCCESS)
+        printf("ERROR! could not write trace file \"%s\"\n", options.trace_path);
+
+    /* print the cross reference index if asked to */
+    if(options.dump_xref_path && (res = dump_xref_file(options.dump_xref_path, options.dump_xref_symbol)) != SUCCESS)
+    {
+        if(res == ERR_MISSING_SYMBOL)
+            printf("ERROR! symbol \"%s\" not found in \"%s\"\n", options.dump_xref_symbol, options.dump_xref_path);
+        else
+            printf("ERROR! could not read cross reference file \"%s\"\n", options.dump_xref_path);
+    }
+
+    /* print the compressed object file as text if asked to */
+    if(options.decompress_path)
     {
-        assemble(argv[i]);
+        if(options.decompress_address < 0)
+            res = decompress_object_file(options.decompress_path, stdout);
+        else if((res = read_compressed_word(options.decompress_path, options.decompress_address, &val)) == SUCCESS)
+            printf("%07ld %06lx\n", options.decompress_address, val);
+
+        if(res == ERR_VALUE_OUT_OF_RANGE)
+            printf("ERROR! address %ld not found in \"%s\"\n", options.decompress_address, options.decompress_path);
+        else if(res != SUCCESS)
+            printf("ERROR! could not read compressed object file \"%s\"\n", options.decompress_path);
     }
 
+    /* print the object file as source text if asked to */
+    if(options.disassemble_path && (res = disassemble_object_file(options.disassemble_path, stdout, &address, &line)) != SUCCESS)
+    {
+        if(res == ERR_COULD_NOT_OPEN_FILE)
+            printf("ERROR! could not read object file \"%s.ob\"\n", options.disassemble_path);
+        else if(line)
+            printf("ERROR! could not disassemble \"%s\": %s [line %lu]\n", options.disassemble_path, error_code_to_string(res), line);
+        else
+            printf("ERROR! could not disassemble \"%s\": %s [address %lu]\n", options.disassemble_path, error_code_to_string(res), address);
+    }
+
+    /* keep reassembling on changes if asked to */
+    if(options.watch && number_of_files > 0)
+        watch_files(files, number_of_files);
+    free_included_files();
+    free(files);
+
     /* return number of files */
     return i;
 }
-
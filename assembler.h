@@ -0,0 +1,6 @@
+#ifndef _ASSEMBLER_H
+#define _ASSEMBLER_H
+
+void assemble(char *file_path);
+
+#endif
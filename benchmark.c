@@ -0,0 +1,363 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "utilities.h"
+#include "instructions_table.h"
+#include "symbols_table.h"
+#include "memory_map.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/*
+ * microbenchmarks of the parser and table hot paths.
+ * every benchmark is calibrated to run for at least BENCH_MIN_RUN_NS, warmed up and then run
+ * BENCH_RUNS times. results(ns/op and cycles/op mean, standard deviation & minimum) are printed,
+ * and written as csv with --output=FILE so they can be compared with --compare=FILE later.
+ */
+
+#define BENCH_WARMUP_RUNS 2
+#define BENCH_RUNS 10
+#define BENCH_MIN_RUN_NS 20000000.0
+#define BENCH_MAX_NAME_LEN 64
+#define BENCH_MAX_LINE_LEN 256
+
+typedef struct {
+    char *name;
+    void (*setup)(unsigned int size); /* NULL if there's nothing to prepare */
+    void (*run)(unsigned long iterations);
+    void (*cleanup)(void); /* NULL if there's nothing to free */
+    unsigned int size; /* table/segment size, 0 if it doesn't apply */
+} benchmark;
+
+typedef struct {
+    double ns_mean, ns_stddev, ns_min;
+    double cycles_mean;
+    unsigned long iterations;
+} benchmark_result;
+
+/* results of the benchmarks go here so the compiler can't drop them */
+volatile unsigned long sink;
+
+/* the inputs, a mix of what real sources look like */
+char *operand_pairs[] = {"r1, r2", "#-5, LABEL", "&LOOP", "LONGLABELNAME , r7", "#100000,r3", "STR", " r0 ,  ARRAY", "#1"};
+char *operands[] = {"#5", "&LOOP", "r3", "LABEL", "#-100000", "r7", "STRINGLABEL", "&X"};
+char *numbers[] = {"5", "-1", "123456", "-1048576", "+42", "0", "999999", "-77"};
+char *instruction_names[] = {"mov", "cmp", "add", "sub", "lea", "clr", "not", "inc", "dec", "jmp", "bne", "jsr", "red", "prn", "rts", "stop"};
+char *labels[] = {"LOOP", "MAIN", "A", "ThisIsALongerLabelName123", "x1", "END", "mov", "STR"};
+
+#define NUMBER_OF(array) (sizeof(array) / sizeof(*(array)))
+
+/* what the table & segment benchmarks work on */
+symbol_table bench_symbols;
+char (*bench_names)[MAX_LABEL_LEN + 1];
+unsigned int bench_size;
+memory_segment bench_segment;
+FILE *bench_null;
+
+/* nanoseconds since an arbitrary point */
+double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* time stamp counter, counts at a constant(reference) rate. 0 where there's none.
+ * only the differences are used, so wrapping around a 32-bit long is fine */
+unsigned long read_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned long lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return (hi << 16 << 16) | lo;
+#else
+    return 0;
+#endif
+}
+
+void run_split_operands(unsigned long iterations)
+{
+    char buf[BENCH_MAX_LINE_LEN], op1[MAX_LABEL_LEN + 1], op2[MAX_LABEL_LEN + 1];
+    unsigned long i;
+    for(i = 0; i < iterations; i++)
+    {
+        /* split_operands cuts the string, work on a copy */
+        strcpy(buf, operand_pairs[i % NUMBER_OF(operand_pairs)]);
+        sink += split_operands(buf, op1, op2);
+    }
+}
+
+void run_read_addressing_method(unsigned long iterations)
+{
+    unsigned long i;
+    for(i = 0; i < iterations; i++)
+        sink += read_addressing_method(operands[i % NUMBER_OF(operands)]);
+}
+
+void run_read_int21(unsigned long iterations)
+{
+    word w;
+    unsigned long i;
+    for(i = 0; i < iterations; i++)
+    {
+        sink += read_int21(numbers[i % NUMBER_OF(numbers)], &w);
+        sink += w.val;
+    }
+}
+
+void run_read_int24(unsigned long iterations)
+{
+    word w;
+    unsigned long i;
+    for(i = 0; i < iterations; i++)
+    {
+        sink += read_int24(numbers[i % NUMBER_OF(numbers)], &w);
+        sink += w.val;
+    }
+}
+
+void run_get_instruction_id(unsigned long iterations)
+{
+    unsigned long i;
+    for(i = 0; i < iterations; i++)
+        sink += get_instruction_id(instruction_names[i % NUMBER_OF(instruction_names)]);
+}
+
+void run_label_len(unsigned long iterations)
+{
+    unsigned long i;
+    for(i = 0; i < iterations; i++)
+        sink += label_len(labels[i % NUMBER_OF(labels)]);
+}
+
+void run_is_valid_label(unsigned long iterations)
+{
+    unsigned long i;
+    for(i = 0; i < iterations; i++)
+        sink += is_valid_label(labels[i % NUMBER_OF(labels)]);
+}
+
+/* symbol table of size symbols, named so lookups hit all over the table */
+void setup_symbols(unsigned int size)
+{
+    unsigned int i;
+    init_symbol_table(&bench_symbols);
+    if(!(bench_names = malloc(size * sizeof(*bench_names))))
+        exit(EXIT_FAILURE);
+    for(i = 0; i < size; i++)
+    {
+        sprintf(bench_names[i], "SYM%u", i);
+        add_symbol(&bench_symbols, bench_names[i], i, i % 2 ? code : data);
+    }
+    bench_size = size;
+}
+
+void cleanup_symbols(void)
+{
+    free_symbols_table(&bench_symbols);
+    free(bench_names);
+}
+
+void run_resolve_symbol(unsigned long iterations)
+{
+    unsigned long i;
+    for(i = 0; i < iterations; i++)
+        sink += resolve_symbol(&bench_symbols, bench_names[(i * 2654435761UL) % bench_size])->offset;
+}
+
+/* items are added to a fresh segment, freeing it every size items(included in the time) */
+void run_add_memory_item(unsigned long iterations)
+{
+    unsigned long i;
+    memory_segment segment;
+    init_memory_segment(&segment, 100);
+    for(i = 0; i < iterations; i++)
+    {
+        sink += add_memory_item(&segment, 1 + i % 3, NULL, i);
+        if(!((i + 1) % bench_size))
+        {
+            free_memory_segment(&segment);
+            init_memory_segment(&segment, 100);
+        }
+    }
+    free_memory_segment(&segment);
+}
+
+void setup_add_memory_item(unsigned int size)
+{
+    bench_size = size;
+}
+
+/* segment of size words in items of 1-3 words, written to /dev/null */
+void setup_memory_segment(unsigned int size)
+{
+    unsigned int i, n;
+    word *data;
+
+    init_memory_segment(&bench_segment, 100);
+    for(i = 0; i < size; i += n)
+    {
+        n = size - i < 3 ? size - i : 1 + i % 3;
+        if(!(data = calloc(n, sizeof(word))))
+            exit(EXIT_FAILURE);
+        data->val = i * 2654435761UL;
+        add_memory_item(&bench_segment, n, data, i);
+    }
+    if(!(bench_null = fopen("/dev/null", "w")))
+        exit(EXIT_FAILURE);
+    bench_size = size;
+}
+
+void cleanup_memory_segment(void)
+{
+    free_memory_segment(&bench_segment);
+    fclose(bench_null);
+}
+
+/* every iteration is a word, whole segments are written */
+void run_write_memory_segment(unsigned long iterations)
+{
+    unsigned long i;
+    for(i = 0; i < iterations; i += bench_size)
+        sink += write_memory_segment(bench_null, &bench_segment);
+}
+
+benchmark benchmarks[] = {
+    {"split_operands", NULL, run_split_operands, NULL, 0},
+    {"read_addressing_method", NULL, run_read_addressing_method, NULL, 0},
+    {"read_int21", NULL, run_read_int21, NULL, 0},
+    {"read_int24", NULL, run_read_int24, NULL, 0},
+    {"get_instruction_id", NULL, run_get_instruction_id, NULL, 0},
+    {"label_len", NULL, run_label_len, NULL, 0},
+    {"is_valid_label", NULL, run_is_valid_label, NULL, 0},
+    {"resolve_symbol", setup_symbols, run_resolve_symbol, cleanup_symbols, 16},
+    {"resolve_symbol", setup_symbols, run_resolve_symbol, cleanup_symbols, 256},
+    {"resolve_symbol", setup_symbols, run_resolve_symbol, cleanup_symbols, 4096},
+    {"add_memory_item", setup_add_memory_item, run_add_memory_item, NULL, 4096},
+    {"write_memory_segment", setup_memory_segment, run_write_memory_segment, cleanup_memory_segment, 4096}
+};
+
+/* run a single benchmark, calibrating the number of iterations first */
+void run_benchmark(benchmark *bench, benchmark_result *result)
+{
+    unsigned long iterations = 1;
+    double start, elapsed, ns[BENCH_RUNS], sum = 0, sum_squares = 0;
+    unsigned long cycles_start;
+    double cycles = 0;
+    int i;
+
+    if(bench->setup)
+        bench->setup(bench->size);
+
+    /* find how many iterations take long enough to time */
+    for(;;)
+    {
+        start = now_ns();
+        bench->run(iterations);
+        if((elapsed = now_ns() - start) >= BENCH_MIN_RUN_NS / 10)
+            break;
+        iterations *= 2;
+    }
+    iterations = iterations * (BENCH_MIN_RUN_NS / (elapsed > 1 ? elapsed : 1)) + 1;
+
+    for(i = 0; i < BENCH_WARMUP_RUNS; i++)
+        bench->run(iterations);
+
+    result->ns_min = -1;
+    for(i = 0; i < BENCH_RUNS; i++)
+    {
+        start = now_ns();
+        cycles_start = read_cycles();
+        bench->run(iterations);
+        cycles += (read_cycles() - cycles_start) & 0xffffffffUL;
+        ns[i] = (now_ns() - start) / iterations;
+        sum += ns[i];
+        if(result->ns_min < 0 || ns[i] < result->ns_min)
+            result->ns_min = ns[i];
+    }
+    result->ns_mean = sum / BENCH_RUNS;
+    for(i = 0; i < BENCH_RUNS; i++)
+        sum_squares += (ns[i] - result->ns_mean) * (ns[i] - result->ns_mean);
+    result->ns_stddev = sqrt(sum_squares / (BENCH_RUNS - 1));
+    result->cycles_mean = cycles / BENCH_RUNS / iterations;
+    result->iterations = iterations;
+
+    if(bench->cleanup)
+        bench->cleanup();
+}
+
+/* mean ns/op of the benchmark in a csv written by --output. returns -1 if it isn't there */
+double read_previous_result(FILE *fh, char *name)
+{
+    char line[BENCH_MAX_LINE_LEN], prev_name[BENCH_MAX_NAME_LEN];
+    double ns_mean;
+
+    rewind(fh);
+    while(fgets(line, sizeof(line), fh))
+    {
+        if(sscanf(line, "%63[^,],%lf", prev_name, &ns_mean) == 2 && !strcmp(prev_name, name))
+            return ns_mean;
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *output = NULL, *previous = NULL;
+    char *filter = NULL, name[BENCH_MAX_NAME_LEN];
+    benchmark_result result;
+    double previous_ns;
+    unsigned int i;
+    int arg;
+
+    for(arg = 1; arg < argc; arg++)
+    {
+        if(STARTS_WITH(argv[arg], "--output=") && (output = fopen(argv[arg] + strlen("--output="), "w")))
+            continue;
+        if(STARTS_WITH(argv[arg], "--compare=") && (previous = fopen(argv[arg] + strlen("--compare="), "r")))
+            continue;
+        if(STARTS_WITH(argv[arg], "--filter="))
+        {
+            filter = argv[arg] + strlen("--filter=");
+            continue;
+        }
+        printf("usage: %s [--output=FILE.csv] [--compare=FILE.csv] [--filter=NAME]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(output)
+        fprintf(output, "benchmark,ns_per_op,ns_stddev,ns_min,cycles_per_op,iterations,runs\n");
+    printf("%-28s %10s %10s %10s %12s\n", "benchmark", "ns/op", "stddev", "min", "cycles/op");
+
+    for(i = 0; i < NUMBER_OF(benchmarks); i++)
+    {
+        if(benchmarks[i].size)
+            sprintf(name, "%s/%u", benchmarks[i].name, benchmarks[i].size);
+        else
+            strcpy(name, benchmarks[i].name);
+        if(filter && !strstr(name, filter))
+            continue;
+
+        run_benchmark(benchmarks + i, &result);
+        printf("%-28s %10.2f %10.2f %10.2f %12.1f", name, result.ns_mean, result.ns_stddev, result.ns_min, result.cycles_mean);
+        if(previous && (previous_ns = read_previous_result(previous, name)) > 0)
+            printf(" %+6.1f%%", (result.ns_mean - previous_ns) * 100 / previous_ns);
+        putchar('\n');
+        fflush(stdout);
+
+        if(output)
+            fprintf(output, "%s,%.3f,%.3f,%.3f,%.2f,%lu,%d\n", name, result.ns_mean, result.ns_stddev, result.ns_min,
+                    result.cycles_mean, result.iterations, BENCH_RUNS);
+    }
+
+    if(output)
+        fclose(output);
+    if(previous)
+        fclose(previous);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include "check.h"
+#include "first_pass.h"
+#include "memory_map.h"
+#include "symbols_table.h"
+#include "utilities.h"
+#include "pipeline.h"
+#include "errors.h"
+#include "archive.h"
+#include "alloc_tracking.h"
+
+/* initial number of symbols waiting to be checked */
+#define PENDING_INITIAL_CAPACITY 64
+
+/*
+ * check only: a single pass over the file validating every line, without keeping any encoded words.
+ * symbols used by operands and .entry statements are checked at the end, once all of them are defined.
+ */
+
+/* a symbol used before we know all the symbols */
+typedef struct {
+    char name[MAX_LABEL_LEN + 1]; /* empty for a name too long to be a symbol */
+    unsigned int line_number;
+} pending_symbol;
+
+typedef struct {
+    pending_symbol *items;
+    unsigned int size;
+    unsigned int capacity;
+} pending_symbols;
+
+/* remember a symbol to check at the end. returns SUCCESS on success, error code otherwise. */
+int add_pending_symbol(pending_symbols *pending, char *name, unsigned int len, unsigned int line_number)
+{
+    pending_symbol *tmp;
+
+    if(pending->size == pending->capacity)
+    {
+        pending->capacity = pending->capacity ? pending->capacity * 2 : PENDING_INITIAL_CAPACITY;
+        if(!(tmp = realloc(pending->items, pending->capacity * sizeof(pending_symbol))))
+            return ERR_MEM_ALLOC_FAILED;
+        pending->items = tmp;
+    }
+
+    if(len > MAX_LABEL_LEN)
+        len = 0;
+    memcpy(pending->items[pending->size].name, name, len);
+    pending->items[pending->size].name[len] = '\x0';
+    pending->items[pending->size++].line_number = line_number;
+    return SUCCESS;
+}
+
+/* check a single line, counting the words it takes instead of encoding them */
+int check_line(char *line, unsigned int line_number, unsigned int *code_size, unsigned int *data_size, symbol_table *symbols, pending_symbols *pending)
+{
+    char *label = NULL, *name;
+    int res, tmp, i;
+    unsigned int label_address = 0;
+    symbol_reference references[MAX_REFERENCES];
+    symbol_type type = data;
+    char *sep;
+
+    /* check for label at the start of this line */
+    if((sep = strchr(line, ':')))
+    {
+        *sep = '\x0';
+        label = line;
+        line = skip_whitespaces(sep + 1);
+    }
+
+    if(*line == '.')
+    {
+        /* the symbol of an .entry statement must be defined somewhere */
+        if(read_guide_statement_type(line) == GUIDE_ENTRY)
+        {
+            name = skip_whitespaces(line + strlen(".entry"));
+            for(sep = name; *sep && !isspace(*sep); sep++);
+            if((res = add_pending_symbol(pending, name, sep - name, line_number)) != SUCCESS)
+                return res;
+        }
+
+        if((res = read_guide_line(NULL, line, symbols)) > 0)
+        {
+            label_address = *data_size;
+            *data_size += res;
+        }
+    }
+    else
+    {
+        if((res = read_instruction_line(NULL, references, line)) > 0)
+        {
+            label_address = *code_size;
+            *code_size += res;
+            type = code;
+
+            for(i = 0; i < MAX_REFERENCES && references[i].symbol_name[0] && res > 0; i++)
+            {
+                if((tmp = add_pending_symbol(pending, references[i].symbol_name, strlen(references[i].symbol_name), line_number)) != SUCCESS)
+                    res = tmp;
+            }
+        }
+    }
+
+    /* save the label(if any) in the symbols table for later */
+    if(label && (tmp = add_symbol(symbols, label, label_address, type)) != SUCCESS)
+        res = tmp;
+    return res;
+}
+
+/* hash index of the symbols names, a power of 2 in size and at most half full. returns NULL on failure */
+symbol_entry **index_symbols(symbol_table *symbols, unsigned long *mask)
+{
+    symbol_entry **index;
+    unsigned long i, size = 2;
+    node *curr;
+
+    for(curr = symbols->symbols.head; curr; curr = curr->next)
+        size += 2;
+    for(*mask = 1; *mask < size; *mask <<= 1);
+    if(!(index = calloc(*mask, sizeof(symbol_entry *))))
+        return NULL;
+    (*mask)--;
+
+    for(curr = symbols->symbols.head; curr; curr = curr->next)
+    {
+        for(i = hash_string(((symbol_entry *)curr->data)->name) & *mask; index[i]; i = (i + 1) & *mask);
+        index[i] = (symbol_entry *)curr->data;
+    }
+    return index;
+}
+
+/* report the pending symbols which were never defined. returns number of errors */
+int check_pending_symbols(symbol_table *symbols, pending_symbols *pending)
+{
+    symbol_entry **index;
+    unsigned long i, mask;
+    unsigned int j, last_line_number = 0;
+    int number_of_errors = 0;
+
+    if(!(index = index_symbols(symbols, &mask)))
+    {
+        printf("ERROR! %s\r\n", error_code_to_string(ERR_MEM_ALLOC_FAILED));
+        return 1;
+    }
+
+    for(j = 0; j < pending->size; j++)
+    {
+        for(i = hash_string(pending->items[j].name) & mask; index[i] && strcmp(index[i]->name, pending->items[j].name); i = (i + 1) & mask);
+        /* like the second pass, a line is reported once */
+        if(!index[i] && pending->items[j].line_number != last_line_number)
+        {
+            last_line_number = pending->items[j].line_number;
+            printf("ERROR! %s [line %d]\r\n", error_code_to_string(ERR_MISSING_SYMBOL), pending->items[j].line_number);
+            number_of_errors++;
+        }
+    }
+    free(index);
+    return number_of_errors;
+}
+
+/* check a file for errors without encoding it or writing anything. returns number of error(lines) found in the file. */
+int check_file(char *filename)
+{
+    FILE *fh;
+    char *buf = NULL;
+    unsigned int buf_size = 0;
+    char *line;
+    int res;
+    unsigned line_number = 1;
+    int number_of_errors = 0;
+    unsigned int code_size = 0, data_size = 0;
+    symbol_table symbols;
+    pending_symbols pending = {NULL, 0, 0};
+
+    if(!(fh = open_archive_source(filename)) && !(fh = pipeline_open_source(filename)))
+    {
+        printf("ERROR! could not open file \"%s\"\n", filename);
+        return 1;
+    }
+    printf(">> Checking \"%s\"...\n", filename);
+    init_symbol_table(&symbols);
+
+    /* read and check one line at a time */
+    while(read_line(fh, &buf, &buf_size))
+    {
+        /* skip blank lines and comments */
+        if(*(line = skip_whitespaces(buf)) && *line != ';')
+        {
+            res = check_line(line, line_number, &code_size, &data_size, &symbols, &pending);
+            if(res < 0) /* check for errors */
+            {
+                printf("ERROR! %s [line %d]\r\n", error_code_to_string(res), line_number);
+                number_of_errors++;
+            }
+        }
+        line_number++;
+    }
+    number_of_errors += check_pending_symbols(&symbols, &pending);
+
+    if(number_of_errors)
+        printf(">> %s found\n", number_of_errors > 1 ? "Errors" : "Error");
+    else
+        puts(">> No errors found");
+
+    free(buf);
+    free(pending.items);
+    free_symbols_table(&symbols);
+    pipeline_close_source(fh);
+    return number_of_errors;
+}
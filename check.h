@@ -0,0 +1,6 @@
+#ifndef _CHECK_H
+#define _CHECK_H
+
+int check_file(char *filename);
+
+#endif
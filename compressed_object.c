@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "compressed_object.h"
+#include "utilities.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/*
+ * the compressed object file holds the same words as the .ob file:
+ * header, blocks of up to OBZ_BLOCK_WORDS sequential words, then the block index.
+ * a block is the distance of its address from the end of the previous block(from 0 for the first one), the number of words
+ * and tokens of literal words or runs of a repeated word. each token starts with count << 1 | is run.
+ * all these numbers are varints(7 bits a byte, least significant first), words are zigzag encoded
+ * first so small negative values stay short. the index has the address & file offset of every block.
+ */
+
+typedef struct {
+    FILE *fh;
+    unsigned long words[OBZ_BLOCK_WORDS];
+    unsigned int number_of_words;
+    unsigned long block_address; /* address of words[0] */
+    unsigned long next_address; /* address following the last block written */
+    unsigned long *index; /* address & offset of each block written */
+    unsigned long number_of_blocks;
+    unsigned long index_capacity;
+} obz_writer;
+
+/* write unsigned integer as varint */
+void write_varint(FILE *fh, unsigned long val)
+{
+    while(val >= 0x80)
+    {
+        putc((val & 0x7f) | 0x80, fh);
+        val >>= 7;
+    }
+    putc(val, fh);
+}
+
+/* read varint written by write_varint. returns SUCCESS on success, error code otherwise. */
+int read_varint(FILE *fh, unsigned long *val)
+{
+    int c, shift = 0;
+    *val = 0;
+    do
+    {
+        if((c = getc(fh)) == EOF || shift > 28)
+            return ERR_INVALID_VALUE;
+        *val |= (unsigned long)(c & 0x7f) << shift;
+        shift += 7;
+    } while(c & 0x80);
+    return SUCCESS;
+}
+
+/* map 24-bit word so small negative values become small numbers: 0, -1, 1, -2, 2... */
+unsigned long zigzag_word(unsigned long val)
+{
+    return val & 0x800000UL ? ((0x1000000UL - val) << 1) - 1 : val << 1;
+}
+
+/* reverse of zigzag_word */
+unsigned long unzigzag_word(unsigned long val)
+{
+    return val & 1 ? (0x1000000UL - ((val + 1) >> 1)) & WORD_MASK : (val >> 1) & WORD_MASK;
+}
+
+/* number of words equal to words[i] starting at i */
+unsigned int run_length(unsigned long *words, unsigned int i, unsigned int n)
+{
+    unsigned int j;
+    for(j = i + 1; j < n && words[j] == words[i]; j++);
+    return j - i;
+}
+
+/* write the start of a block of n words at address, and remember where it is for random access.
+ * returns SUCCESS on success, error code otherwise. */
+int start_block(obz_writer *writer, unsigned long address, unsigned int n)
+{
+    unsigned long *index;
+
+    if(writer->number_of_blocks == writer->index_capacity)
+    {
+        writer->index_capacity = writer->index_capacity ? writer->index_capacity * 2 : 16;
+        if(!(index = realloc(writer->index, writer->index_capacity * 2 * sizeof(unsigned long))))
+            return ERR_MEM_ALLOC_FAILED;
+        writer->index = index;
+    }
+    writer->index[writer->number_of_blocks * 2] = address;
+    writer->index[writer->number_of_blocks * 2 + 1] = ftell(writer->fh);
+    writer->number_of_blocks++;
+
+    write_varint(writer->fh, address - writer->next_address);
+    write_varint(writer->fh, n);
+    return SUCCESS;
+}
+
+/* encode the buffered words as a block. returns SUCCESS on success, error code otherwise. */
+int flush_block(obz_writer *writer)
+{
+    unsigned int i, j, n = writer->number_of_words;
+    int res;
+
+    if(!n)
+        return SUCCESS;
+    if((res = start_block(writer, writer->block_address, n)) != SUCCESS)
+        return res;
+    for(i = 0; i < n; i = j)
+    {
+        if((j = i + run_length(writer->words, i, n)) - i >= OBZ_MIN_RUN)
+        {
+            write_varint(writer->fh, (unsigned long)(j - i) << 1 | 1);
+            write_varint(writer->fh, zigzag_word(writer->words[i]));
+        }
+        else
+        {
+            /* literals up to the next run */
+            for(j = i + 1; j < n && run_length(writer->words, j, n) < OBZ_MIN_RUN; j++);
+            write_varint(writer->fh, (unsigned long)(j - i) << 1);
+            for(; i < j; i++)
+                write_varint(writer->fh, zigzag_word(writer->words[i]));
+        }
+    }
+
+    writer->next_address = writer->block_address + n;
+    writer->number_of_words = 0;
+    return SUCCESS;
+}
+
+/* add word to the current block, starting a new one when full or the address isn't sequential */
+int put_word(obz_writer *writer, unsigned long address, unsigned long val)
+{
+    int res = SUCCESS;
+    if(writer->number_of_words == OBZ_BLOCK_WORDS ||
+       (writer->number_of_words && address != writer->block_address + writer->number_of_words))
+        res = flush_block(writer);
+    if(!writer->number_of_words)
+        writer->block_address = address;
+    writer->words[writer->number_of_words++] = val;
+    return res;
+}
+
+/* add count copies of a word, every whole block of them is written right away as a single run. returns SUCCESS on success, error code otherwise. */
+int put_run(obz_writer *writer, unsigned long address, unsigned long val, unsigned long count)
+{
+    int res = SUCCESS;
+
+    while(count && res == SUCCESS)
+    {
+        if(count < OBZ_BLOCK_WORDS)
+        {
+            res = put_word(writer, address++, val);
+            count--;
+        }
+        else if((res = flush_block(writer)) == SUCCESS && (res = start_block(writer, address, OBZ_BLOCK_WORDS)) == SUCCESS)
+        {
+            write_varint(writer->fh, (unsigned long)OBZ_BLOCK_WORDS << 1 | 1);
+            write_varint(writer->fh, zigzag_word(val));
+            writer->next_address = address += OBZ_BLOCK_WORDS;
+            count -= OBZ_BLOCK_WORDS;
+        }
+    }
+    return res;
+}
+
+/* add all the words of segment. returns SUCCESS on success, error code otherwise. */
+int put_memory_segment(obz_writer *writer, memory_segment *segment)
+{
+    node *curr_node;
+    memory_item *curr_item;
+    unsigned int j;
+    int res = SUCCESS;
+
+    for(curr_node = segment->items.head; curr_node && res == SUCCESS; curr_node = curr_node->next)
+    {
+        curr_item = (memory_item *)curr_node->data;
+        if(curr_item->is_run)
+        {
+            res = put_run(writer, calc_absolute_address(segment, curr_item), curr_item->data->val, curr_item->size_in_words);
+            continue;
+        }
+        for(j = 0; j < curr_item->size_in_words && res == SUCCESS; j++)
+            res = put_word(writer, calc_absolute_address(segment, curr_item) + j, curr_item->data[j].val);
+    }
+    return res;
+}
+
+/* write all the machine code to compressed object file. returns SUCCESS on success, error code otherwise. */
+int write_compressed_object_file(char *file_path, memory_segment *code_segment, memory_segment *data_segment)
+{
+    char name[MAX_FILE_PATH];
+    obz_writer *writer;
+    unsigned long i, index_offset;
+    int res = ERR_MEM_ALLOC_FAILED;
+
+    if(!(writer = calloc(1, sizeof(obz_writer))))
+        return res;
+
+    sprintf(name, "%s.obz", file_path);
+    if((writer->fh = fopen(name, "wb")))
+    {
+        write_u32(writer->fh, OBZ_FILE_MAGIC);
+        write_u32(writer->fh, size_of_segment(code_segment));
+        write_u32(writer->fh, size_of_segment(data_segment));
+        write_u32(writer->fh, 0);
+        write_u32(writer->fh, 0);
+
+        if((res = put_memory_segment(writer, code_segment)) == SUCCESS &&
+           (res = put_memory_segment(writer, data_segment)) == SUCCESS &&
+           (res = flush_block(writer)) == SUCCESS)
+        {
+            index_offset = ftell(writer->fh);
+            for(i = 0; i < writer->number_of_blocks * 2; i++)
+                write_u32(writer->fh, writer->index[i]);
+
+            /* the index location is known only now */
+            fseek(writer->fh, 12, SEEK_SET);
+            write_u32(writer->fh, writer->number_of_blocks);
+            write_u32(writer->fh, index_offset);
+            if(ferror(writer->fh))
+                res = ERR_COULD_NOT_OPEN_FILE;
+        }
+        fclose(writer->fh);
+    }
+    else
+    {
+        res = ERR_COULD_NOT_OPEN_FILE;
+    }
+    free(writer->index);
+    free(writer);
+    return res;
+}
+
+/* decode the block at the current position into words. returns number of words on success, error code otherwise. */
+int read_block(FILE *fh, unsigned long *address_delta, unsigned long *words)
+{
+    unsigned long n, token, count, val, i = 0;
+
+    if(read_varint(fh, address_delta) != SUCCESS || read_varint(fh, &n) != SUCCESS || n > OBZ_BLOCK_WORDS)
+        return ERR_INVALID_VALUE;
+    while(i < n)
+    {
+        if(read_varint(fh, &token) != SUCCESS || (count = token >> 1) == 0 || count > n - i)
+            return ERR_INVALID_VALUE;
+        if(token & 1)
+        {
+            if(read_varint(fh, &val) != SUCCESS)
+                return ERR_INVALID_VALUE;
+            for(val = unzigzag_word(val); count; count--)
+                words[i++] = val;
+        }
+        else
+        {
+            for(; count; count--)
+            {
+                if(read_varint(fh, &val) != SUCCESS)
+                    return ERR_INVALID_VALUE;
+                words[i++] = unzigzag_word(val);
+            }
+        }
+    }
+    return n;
+}
+
+/* read the header of compressed object file, leaving fh after it. returns SUCCESS on success, error code otherwise. */
+int read_obz_header(FILE *fh, unsigned long *code_size, unsigned long *data_size, unsigned long *number_of_blocks, unsigned long *index_offset)
+{
+    if(read_u32(fh) != OBZ_FILE_MAGIC)
+        return ERR_INVALID_VALUE;
+    *code_size = read_u32(fh);
+    *data_size = read_u32(fh);
+    *number_of_blocks = read_u32(fh);
+    *index_offset = read_u32(fh);
+    return feof(fh) ? ERR_INVALID_VALUE : SUCCESS;
+}
+
+/* write compressed object file to out in the text object format, a block at a time. returns SUCCESS on success, error code otherwise. */
+int decompress_object_file(char *obz_path, FILE *out)
+{
+    FILE *fh;
+    unsigned long words[OBZ_BLOCK_WORDS];
+    unsigned long code_size, data_size, number_of_blocks, index_offset, address, address_delta, i;
+    int j, n, res;
+
+    if(!(fh = fopen(obz_path, "rb")))
+        return ERR_COULD_NOT_OPEN_FILE;
+
+    if((res = read_obz_header(fh, &code_size, &data_size, &number_of_blocks, &index_offset)) == SUCCESS)
+    {
+        fprintf(out, "%lu %lu\n", code_size, data_size);
+        for(address = 0, i = 0; i < number_of_blocks && res == SUCCESS; i++)
+        {
+            if((n = read_block(fh, &address_delta, words)) < 0)
+            {
+                res = n;
+            }
+            else
+            {
+                for(address += address_delta, j = 0; j < n; j++, address++)
+                    fprintf(out, "%07lu %06lx\n", address, words[j]);
+            }
+        }
+    }
+    fclose(fh);
+    return res;
+}
+
+/* read a single word from compressed object file using the block index. returns SUCCESS on success, error code otherwise. */
+int read_compressed_word(char *obz_path, unsigned long address, unsigned long *val)
+{
+    FILE *fh;
+    unsigned long words[OBZ_BLOCK_WORDS];
+    unsigned long code_size, data_size, number_of_blocks, index_offset, address_delta, block_address = 0, block_offset = 0;
+    unsigned long low, high, middle;
+    int n, res;
+
+    if(!(fh = fopen(obz_path, "rb")))
+        return ERR_COULD_NOT_OPEN_FILE;
+
+    if((res = read_obz_header(fh, &code_size, &data_size, &number_of_blocks, &index_offset)) == SUCCESS)
+    {
+        /* find the last block starting at or before address */
+        for(low = 0, high = number_of_blocks, res = ERR_VALUE_OUT_OF_RANGE; low < high; )
+        {
+            middle = low + (high - low) / 2;
+            fseek(fh, index_offset + middle * 8, SEEK_SET);
+            if(read_u32(fh) <= address)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        if(low > 0)
+        {
+            fseek(fh, index_offset + (low - 1) * 8, SEEK_SET);
+            block_address = read_u32(fh);
+            block_offset = read_u32(fh);
+            fseek(fh, block_offset, SEEK_SET);
+            if((n = read_block(fh, &address_delta, words)) < 0)
+                res = n;
+            else if(address - block_address < (unsigned long)n)
+            {
+                *val = words[address - block_address];
+                res = SUCCESS;
+            }
+        }
+    }
+    fclose(fh);
+    return res;
+}
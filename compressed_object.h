@@ -0,0 +1,26 @@
+#ifndef _COMPRESSED_OBJECT_H
+#define _COMPRESSED_OBJECT_H
+
+#include <stdio.h>
+
+#include "memory_map.h"
+
+/* magic number at the start of the compressed object file("OBZ1") */
+#define OBZ_FILE_MAGIC 0x315a424fUL
+
+/* maximum number of words in a block, the unit of random access */
+#define OBZ_BLOCK_WORDS 1024
+
+/* shortest run of equal words worth encoding as a run */
+#define OBZ_MIN_RUN 3
+
+/* magic, code size, data size, number of blocks & offset of the block index */
+#define OBZ_HEADER_SIZE 20
+
+void write_varint(FILE *fh, unsigned long val);
+int read_varint(FILE *fh, unsigned long *val);
+int write_compressed_object_file(char *file_path, memory_segment *code_segment, memory_segment *data_segment);
+int decompress_object_file(char *obz_path, FILE *out);
+int read_compressed_word(char *obz_path, unsigned long address, unsigned long *val);
+
+#endif
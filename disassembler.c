@@ -0,0 +1,650 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disassembler.h"
+#include "instructions_table.h"
+#include "memory_map.h"
+#include "utilities.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/*
+ * turns an object file back into source text which assembles to the same words.
+ * the instruction of a word is looked up by its opcode & funct, and the operand words following it are known
+ * from its addressing methods. the addresses operands hold are named from the .ent & .ext files, or get a
+ * generated label(L<address>) when there's no name for them.
+ * the whole image is checked before anything is written, so the text is either complete or not written at all.
+ * only the words and a byte of marks are kept for each address, the few names are looked up by address when needed.
+ */
+
+/* kinds of the names in the index */
+#define NAME_ENTRY 1
+#define NAME_EXTERNAL 2
+#define NAME_DECLARED 4 /* its .entry/.extern line was written */
+
+/* marks of each word of the image */
+#define MARK_INSTRUCTION 0x1 /* first word of an instruction */
+#define MARK_TARGET 0x2 /* an operand holds its address, so it needs a label */
+#define MARK_EXTERNAL 0x4 /* operand word of an external symbol */
+#define MARK_ENTRY 0x8 /* an entry is defined at it */
+#define MARK_EXTERNAL_NAME 0x10 /* the .ext file names the external it uses */
+
+typedef struct {
+    unsigned long index; /* of the word in the image */
+    char *name;
+} word_name;
+
+/* the names of a .ent/.ext file */
+typedef struct {
+    char *text; /* the file, the names point into it */
+    word_name *names; /* sorted by index */
+    unsigned long number_of_names;
+} name_list;
+
+typedef struct {
+    unsigned long base_address; /* of the first word, the data follows the code */
+    unsigned long code_size;
+    unsigned long data_size;
+    unsigned long number_of_words; /* read so far */
+    word *words;
+    unsigned char *marks;
+    name_list entries;
+    name_list externals;
+    char **names; /* hash index of every name of the files, a power of 2 in size and at most half full */
+    unsigned char *name_kinds; /* of each name in the index */
+    unsigned long names_mask;
+    unsigned long error_address; /* where the image turned out to be invalid */
+    unsigned long error_line; /* the line of the .ob file that couldn't be read, 0 if it was read */
+} object_image;
+
+typedef struct {
+    FILE *fh;
+    char *buf; /* DISASSEMBLY_BUFFER_SIZE bytes */
+    unsigned int len;
+} text_output;
+
+/* instruction number of each opcode & funct pair, -1 for none */
+signed char instruction_by_code[NUMBER_OF_OPCODES][NUMBER_OF_FUNCTS];
+
+/* fill the lookup of the instructions by their opcode & funct */
+void build_instruction_lookup(void)
+{
+    int i;
+
+    memset(instruction_by_code, -1, sizeof(instruction_by_code));
+    for(i = 0; i < get_number_of_instructions(); i++)
+        instruction_by_code[get_opcode(i)][get_funct(i)] = i;
+}
+
+/* read a decimal(base 10) or hex(base 16) number from [p, end). returns a pointer right after it, NULL if there's none */
+char *read_object_number(char *p, char *end, int base, unsigned long *val)
+{
+    char *start = p;
+    int digit;
+
+    for(*val = 0; p < end; p++)
+    {
+        if(*p >= '0' && *p <= '9')
+            digit = *p - '0';
+        else if(base == 16 && *p >= 'a' && *p <= 'f')
+            digit = *p - 'a' + 10;
+        else
+            break;
+
+        /* no address or word comes close */
+        if(*val > 0xfffffffUL)
+            return NULL;
+        *val = *val * base + digit;
+    }
+    return p == start ? NULL : p;
+}
+
+/* read the complete lines [p, end) of the object file into image, file_size bytes long in total.
+ * returns SUCCESS on success, error code otherwise */
+int read_object_lines(object_image *image, char *p, char *end, unsigned long file_size)
+{
+    unsigned long address, val;
+
+    /* the header has the sizes of both segments */
+    if(!image->words)
+    {
+        if(!(p = read_object_number(p, end, 10, &image->code_size)) || p == end || *p++ != ' ' ||
+           !(p = read_object_number(p, end, 10, &image->data_size)) || p == end || *p++ != '\n')
+            return ERR_INVALID_OBJECT_FILE;
+
+        /* every line takes at least 4 chars, don't trust the header with more than that */
+        if(image->code_size + image->data_size > file_size / 4)
+            return ERR_INVALID_OBJECT_FILE;
+        if(!(image->words = malloc((image->code_size + image->data_size + 1) * sizeof(word))) ||
+           !(image->marks = calloc(image->code_size + image->data_size + 1, 1)))
+            return ERR_MEM_ALLOC_FAILED;
+    }
+
+    for(; p < end; image->number_of_words++)
+    {
+        if(image->number_of_words == image->code_size + image->data_size ||
+           !(p = read_object_number(p, end, 10, &address)) || p == end || *p++ != ' ' ||
+           !(p = read_object_number(p, end, 16, &val)) || p == end || *p++ != '\n' || val > WORD_MASK)
+            return ERR_INVALID_OBJECT_FILE;
+
+        /* the words are sequential, starting from the base of the code */
+        if(address != image->base_address + image->number_of_words)
+            return ERR_INVALID_OBJECT_FILE;
+        image->words[image->number_of_words].val = val;
+    }
+    return SUCCESS;
+}
+
+/* read the .ob file into image, a chunk at a time. returns SUCCESS on success, error code otherwise */
+int load_object_words(object_image *image, char *file_path)
+{
+    char name[MAX_FILE_PATH], *buf, *last;
+    FILE *fh;
+    unsigned long len = 0, n;
+    long file_size;
+    int res = ERR_COULD_NOT_OPEN_FILE;
+
+    sprintf(name, "%s.ob", file_path);
+    if(!(fh = fopen(name, "rb")))
+        return res;
+
+    if(fseek(fh, 0, SEEK_END) == 0 && (file_size = ftell(fh)) >= 0 && fseek(fh, 0, SEEK_SET) == 0)
+    {
+        res = ERR_MEM_ALLOC_FAILED;
+        if((buf = malloc(OBJECT_READ_BUFFER_SIZE)))
+        {
+            /* read the complete lines of each chunk, the start of the last line is kept for the next one */
+            res = SUCCESS;
+            while(res == SUCCESS && (n = fread(buf + len, 1, OBJECT_READ_BUFFER_SIZE - len, fh)) > 0)
+            {
+                len += n;
+                for(last = buf + len; last > buf && last[-1] != '\n'; last--);
+                if(last == buf)
+                {
+                    res = len == OBJECT_READ_BUFFER_SIZE ? ERR_INVALID_OBJECT_FILE : SUCCESS;
+                    continue;
+                }
+                res = read_object_lines(image, buf, last, file_size);
+                len -= last - buf;
+                memmove(buf, last, len);
+            }
+
+            /* nothing is left after the last line, and all the words the header promised are there */
+            if(res == SUCCESS && (len || !image->words || image->number_of_words != image->code_size + image->data_size))
+                res = ERR_INVALID_OBJECT_FILE;
+
+            /* the header is the first line, word i is on line i + 2 */
+            if(res == ERR_INVALID_OBJECT_FILE)
+                image->error_line = image->words ? image->number_of_words + 2 : 1;
+            free(buf);
+        }
+    }
+    fclose(fh);
+    return res;
+}
+
+int compare_word_names(const void *a, const void *b)
+{
+    unsigned long first = ((word_name *)a)->index, second = ((word_name *)b)->index;
+    return first < second ? -1 : first > second;
+}
+
+/* read the "name address" lines of the .ent/.ext file of file_path into names, sorted by address, and put mark on their words.
+ * a missing file has no names. returns SUCCESS on success, error code otherwise */
+int load_object_names(object_image *image, char *file_path, char *extension, name_list *names, unsigned char mark)
+{
+    char name[MAX_FILE_PATH], *line, *sep, *end;
+    unsigned long address, i, number_of_lines = 0;
+    int res, sorted = 1;
+
+    sprintf(name, "%s.%s", file_path, extension);
+    if(!(names->text = read_text_file(name)))
+        return SUCCESS;
+
+    for(line = names->text; *line; line++)
+        number_of_lines += *line == '\n';
+    if(!(names->names = malloc((number_of_lines + 1) * sizeof(word_name))))
+        return ERR_MEM_ALLOC_FAILED;
+
+    for(line = names->text; *line; line = end + 1)
+    {
+        if(!(end = strchr(line, '\n')) || !(sep = strchr(line, ' ')) || sep > end)
+            return ERR_INVALID_OBJECT_FILE;
+        *end = '\x0';
+        *sep++ = '\x0';
+
+        if(read_object_number(sep, end, 10, &address) != end)
+            return ERR_INVALID_OBJECT_FILE;
+        image->error_address = address;
+        if((res = is_valid_label(line)) != OK)
+            return res;
+        if(address < image->base_address || address - image->base_address >= image->code_size + image->data_size)
+            return ERR_VALUE_OUT_OF_RANGE;
+
+        names->names[names->number_of_names].index = address - image->base_address;
+        names->names[names->number_of_names].name = line;
+        if(names->number_of_names && names->names[names->number_of_names - 1].index >= address - image->base_address)
+            sorted = 0;
+        names->number_of_names++;
+    }
+
+    /* the externals are already in order of their words, the entries are in the order they were declared */
+    if(!sorted)
+        qsort(names->names, names->number_of_names, sizeof(word_name), compare_word_names);
+    for(i = 0; i < names->number_of_names; i++)
+    {
+        image->error_address = image->base_address + names->names[i].index;
+        if(i && names->names[i].index == names->names[i - 1].index)
+            return ERR_SYMBOL_ALREADY_EXISTS;
+        image->marks[names->names[i].index] |= mark;
+    }
+    return SUCCESS;
+}
+
+/* returns the name of the word at index in names */
+char *find_word_name(name_list *names, unsigned long index)
+{
+    unsigned long low = 0, high = names->number_of_names, middle;
+
+    while(high - low > 1)
+    {
+        middle = (low + high) / 2;
+        if(names->names[middle].index <= index)
+            low = middle;
+        else
+            high = middle;
+    }
+    return names->names[low].name;
+}
+
+/* returns the slot of name in the index, or the empty slot it would go in */
+unsigned long find_name(object_image *image, char *name)
+{
+    unsigned long i;
+    for(i = hash_string(name) & image->names_mask; image->names[i] && strcmp(image->names[i], name); i = (i + 1) & image->names_mask);
+    return i;
+}
+
+/* index the names of the image. an external is listed once for every word using it, but an entry is defined only once.
+ * returns SUCCESS on success, error code otherwise */
+int index_names(object_image *image)
+{
+    unsigned long i, slot, size;
+    name_list *names;
+    int kind;
+
+    for(size = 1; size < 2 * (image->entries.number_of_names + image->externals.number_of_names) + 2; size <<= 1);
+    if(!(image->names = calloc(size, sizeof(char *))) || !(image->name_kinds = calloc(size, 1)))
+        return ERR_MEM_ALLOC_FAILED;
+    image->names_mask = size - 1;
+
+    for(kind = NAME_ENTRY; kind <= NAME_EXTERNAL; kind++)
+    {
+        names = kind == NAME_ENTRY ? &image->entries : &image->externals;
+        for(i = 0; i < names->number_of_names; i++)
+        {
+            image->error_address = image->base_address + names->names[i].index;
+            slot = find_name(image, names->names[i].name);
+            if(image->names[slot] && (kind == NAME_ENTRY || image->name_kinds[slot] == NAME_ENTRY))
+                return ERR_SYMBOL_ALREADY_EXISTS;
+            image->names[slot] = names->names[i].name;
+            image->name_kinds[slot] = kind;
+        }
+    }
+    return SUCCESS;
+}
+
+/* returns the signed value of an operand word */
+long operand_value(unsigned long val)
+{
+    val >>= OPERAND_VALUE_SHIFT;
+    return val & 0x100000UL ? (long)val - 0x200000L : (long)val;
+}
+
+/* returns the address held by operand word i of the instruction at index start, or -1 if it's outside the image */
+long operand_target(object_image *image, unsigned long start, unsigned long i, int addressing_method)
+{
+    long address = addressing_method == ADDR_RELATIVE ? (long)(image->base_address + start) + operand_value(image->words[i].val) :
+                                                        (long)(image->words[i].val >> OPERAND_VALUE_SHIFT);
+    if(address < (long)image->base_address || address >= (long)(image->base_address + image->code_size + image->data_size))
+        return -1;
+    return address;
+}
+
+/* get the addressing method of each operand of an instruction word, the source is the first of two */
+int read_addressing_methods(unsigned long val, int instruction_id, int *methods)
+{
+    int number_of_operands = get_number_of_operands(instruction_id);
+
+    if(number_of_operands == 2)
+        methods[0] = SRC_ADDR_METHOD(val);
+    if(number_of_operands)
+        methods[number_of_operands - 1] = DEST_ADDR_METHOD(val);
+    return number_of_operands;
+}
+
+/* check the instruction at index start of the image and mark the words its operands use.
+ * returns its size in words on success, error code otherwise. */
+int check_instruction(object_image *image, unsigned long start)
+{
+    unsigned long val = image->words[start].val, i;
+    int instruction_id, methods[MAX_OPERANDS], number_of_operands, j;
+    long target;
+    word expected;
+
+    if((instruction_id = instruction_by_code[OPCODE(val)][FUNCT(val)]) < 0)
+        return ERR_INVALID_INSTRUCTION_WORD;
+
+    /* the word must be exactly what the assembler would encode for these operands */
+    init_instruction(&expected, instruction_id);
+    number_of_operands = read_addressing_methods(val, instruction_id, methods);
+    if(number_of_operands == 2)
+    {
+        if(!is_source_addressing_method_supported(instruction_id, methods[0]))
+            return ERR_INVALID_INSTRUCTION_WORD;
+        expected.val |= (unsigned long)methods[0] << SRC_ADDR_SHIFT;
+        if(methods[0] == ADDR_REG_DIRECT)
+            expected.val |= (unsigned long)SRC_REG(val) << SRC_REG_SHIFT;
+    }
+    if(number_of_operands)
+    {
+        if(!is_dest_addressing_method_supported(instruction_id, methods[number_of_operands - 1]))
+            return ERR_INVALID_INSTRUCTION_WORD;
+        expected.val |= (unsigned long)methods[number_of_operands - 1] << DEST_ADDR_SHIFT;
+        if(methods[number_of_operands - 1] == ADDR_REG_DIRECT)
+            expected.val |= (unsigned long)DEST_REG(val) << DEST_REG_SHIFT;
+    }
+    if(expected.val != val)
+        return ERR_INVALID_INSTRUCTION_WORD;
+
+    /* registers are in the instruction word, every other operand has a word of its own */
+    for(i = start + 1, j = 0; j < number_of_operands; j++)
+    {
+        if(methods[j] == ADDR_REG_DIRECT)
+            continue;
+        if(i >= image->code_size)
+            return ERR_INVALID_INSTRUCTION_WORD;
+
+        image->error_address = image->base_address + i;
+        val = image->words[i].val;
+        if(methods[j] == ADDR_DIRECT && val == ARE_E)
+        {
+            image->marks[i] |= MARK_EXTERNAL;
+        }
+        else if(methods[j] == ADDR_DIRECT ? (val & (ARE_A | ARE_R | ARE_E)) != ARE_R : (val & (ARE_A | ARE_R | ARE_E)) != ARE_A)
+        {
+            return ERR_INVALID_INSTRUCTION_WORD;
+        }
+        else if(methods[j] == ADDR_IMMEDIATE)
+        {
+            if(operand_value(val) < INT21_MIN || operand_value(val) > INT21_MAX)
+                return ERR_INT21_OVERFLOW;
+        }
+        else if((target = operand_target(image, start, i, methods[j])) < 0)
+        {
+            return ERR_VALUE_OUT_OF_RANGE;
+        }
+        else
+        {
+            image->marks[target - image->base_address] |= MARK_TARGET;
+        }
+        i++;
+    }
+    image->marks[start] |= MARK_INSTRUCTION;
+    return i - start;
+}
+
+/* make sure the image can be written as source text. returns SUCCESS if it can, error code otherwise */
+int check_image(object_image *image)
+{
+    unsigned long i;
+    long val;
+    int res;
+
+    for(i = 0; i < image->code_size; i += res)
+    {
+        image->error_address = image->base_address + i;
+        if((res = check_instruction(image, i)) < 0)
+            return res;
+    }
+
+    for(i = 0; i < image->code_size + image->data_size; i++)
+    {
+        image->error_address = image->base_address + i;
+
+        /* labels of the code are put on instructions */
+        if(i < image->code_size && image->marks[i] & (MARK_ENTRY | MARK_TARGET) && !(image->marks[i] & MARK_INSTRUCTION))
+            return ERR_VALUE_OUT_OF_RANGE;
+
+        /* every word of an external has a name, and nothing else does */
+        if(!(image->marks[i] & MARK_EXTERNAL) != !(image->marks[i] & MARK_EXTERNAL_NAME))
+            return image->marks[i] & MARK_EXTERNAL_NAME ? ERR_INVALID_OBJECT_FILE : ERR_MISSING_SYMBOL;
+
+        if(i >= image->code_size)
+        {
+            val = image->words[i].val & 0x800000UL ? (long)image->words[i].val - 0x1000000L : (long)image->words[i].val;
+            if(val < INT24_MIN || val > INT24_MAX)
+                return ERR_INT24_OVERFLOW;
+        }
+    }
+    return SUCCESS;
+}
+
+void flush_text(text_output *out)
+{
+    fwrite(out->buf, 1, out->len, out->fh);
+    out->len = 0;
+}
+
+void put_text(text_output *out, const char *s, unsigned int len)
+{
+    if(out->len + len > DISASSEMBLY_BUFFER_SIZE)
+        flush_text(out);
+    memcpy(out->buf + out->len, s, len);
+    out->len += len;
+}
+
+void put_string(text_output *out, const char *s)
+{
+    put_text(out, s, strlen(s));
+}
+
+/* write a decimal number. returns the number of chars written */
+unsigned int put_number(text_output *out, long val)
+{
+    char digits[24];
+    unsigned int len = sizeof(digits);
+    unsigned long magnitude = val < 0 ? -(unsigned long)val : (unsigned long)val;
+
+    do
+    {
+        digits[--len] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while(magnitude);
+    if(val < 0)
+        digits[--len] = '-';
+    put_text(out, digits + len, sizeof(digits) - len);
+    return sizeof(digits) - len;
+}
+
+/* write the label of the word at index i, the entry defined there or one generated from its address */
+unsigned int put_label(text_output *out, object_image *image, unsigned long i)
+{
+    char name[MAX_LABEL_LEN + 1], *entry;
+    unsigned int len;
+
+    if(image->marks[i] & MARK_ENTRY)
+    {
+        put_string(out, entry = find_word_name(&image->entries, i));
+        return strlen(entry);
+    }
+
+    /* prepend more L's until it's not one of the names */
+    len = sprintf(name, "L%lu", image->base_address + i);
+    while(len < MAX_LABEL_LEN && image->names[find_name(image, name)])
+    {
+        memmove(name + 1, name, ++len);
+        name[0] = 'L';
+    }
+    put_text(out, name, len);
+    return len;
+}
+
+/* write the label definition starting the line of the word at index i(if it needs one), or the indentation */
+unsigned int put_line_start(text_output *out, object_image *image, unsigned long i)
+{
+    unsigned int len;
+
+    if(!(image->marks[i] & (MARK_ENTRY | MARK_TARGET)))
+    {
+        put_text(out, "    ", 4);
+        return 4;
+    }
+    len = put_label(out, image, i);
+    put_text(out, ": ", 2);
+    return len + 2;
+}
+
+/* write the instruction at index start. returns its size in words */
+unsigned long put_instruction(text_output *out, object_image *image, unsigned long start)
+{
+    unsigned long val = image->words[start].val, i = start + 1;
+    int instruction_id = instruction_by_code[OPCODE(val)][FUNCT(val)], methods[MAX_OPERANDS], number_of_operands, j;
+
+    put_line_start(out, image, start);
+    put_string(out, get_instruction_name(instruction_id));
+    number_of_operands = read_addressing_methods(val, instruction_id, methods);
+    for(j = 0; j < number_of_operands; j++)
+    {
+        put_text(out, j ? ", " : " ", j ? 2 : 1);
+        switch(methods[j])
+        {
+            case ADDR_REG_DIRECT:
+                put_text(out, "r", 1);
+                put_number(out, number_of_operands == 2 && j == 0 ? SRC_REG(val) : DEST_REG(val));
+                break;
+
+            case ADDR_IMMEDIATE:
+                put_text(out, "#", 1);
+                put_number(out, operand_value(image->words[i++].val));
+                break;
+
+            case ADDR_DIRECT:
+                if(image->marks[i] & MARK_EXTERNAL)
+                {
+                    put_string(out, find_word_name(&image->externals, i++));
+                    break;
+                }
+                put_label(out, image, operand_target(image, start, i++, ADDR_DIRECT) - image->base_address);
+                break;
+
+            case ADDR_RELATIVE:
+                put_text(out, "&", 1);
+                put_label(out, image, operand_target(image, start, i++, ADDR_RELATIVE) - image->base_address);
+                break;
+        }
+    }
+    put_text(out, "\n", 1);
+    return i - start;
+}
+
+/* write the data words, as many in each .data line as fit and a new line for every label */
+void put_data(text_output *out, object_image *image)
+{
+    unsigned long i, end = image->code_size + image->data_size;
+    unsigned int len = 0;
+    long val;
+
+    for(i = image->code_size; i < end; i++)
+    {
+        val = image->words[i].val & 0x800000UL ? (long)image->words[i].val - 0x1000000L : (long)image->words[i].val;
+
+        /* a value takes up to 8 chars and its separator */
+        if(i == image->code_size || image->marks[i] & (MARK_ENTRY | MARK_TARGET) || len + 10 > MAX_DATA_LINE_LEN)
+        {
+            if(i != image->code_size)
+                put_text(out, "\n", 1);
+            len = put_line_start(out, image, i);
+            put_text(out, ".data ", 6);
+            len += 6;
+        }
+        else
+        {
+            put_text(out, ", ", 2);
+            len += 2;
+        }
+        len += put_number(out, val);
+    }
+    if(image->data_size)
+        put_text(out, "\n", 1);
+}
+
+/* write the source text of the whole image */
+void put_image(text_output *out, object_image *image)
+{
+    unsigned long i, slot;
+    name_list *names;
+
+    /* the externals and the entries first, each once and in the order of their words */
+    for(names = &image->externals; names; names = names == &image->externals ? &image->entries : NULL)
+    {
+        for(i = 0; i < names->number_of_names; i++)
+        {
+            if(image->name_kinds[slot = find_name(image, names->names[i].name)] & NAME_DECLARED)
+                continue;
+            image->name_kinds[slot] |= NAME_DECLARED;
+            put_string(out, names == &image->externals ? ".extern " : ".entry ");
+            put_string(out, names->names[i].name);
+            put_text(out, "\n", 1);
+        }
+    }
+
+    for(i = 0; i < image->code_size; )
+        i += put_instruction(out, image, i);
+    put_data(out, image);
+    flush_text(out);
+}
+
+/* write the object file of file_path(with its .ent & .ext files) as source text to out.
+ * returns SUCCESS on success, error code otherwise(with the address of the word at fault in error_address, or the line
+ * of the .ob file that couldn't be read in error_line) */
+int disassemble_object_file(char *file_path, FILE *out, unsigned long *error_address, unsigned long *error_line)
+{
+    object_image image;
+    text_output text;
+    int res;
+
+    memset(&image, 0, sizeof(image));
+    image.base_address = OBJECT_BASE_ADDRESS;
+    text.fh = out;
+    text.len = 0;
+    build_instruction_lookup();
+
+    if((res = load_object_words(&image, file_path)) == SUCCESS &&
+       (res = load_object_names(&image, file_path, "ext", &image.externals, MARK_EXTERNAL_NAME)) == SUCCESS &&
+       (res = load_object_names(&image, file_path, "ent", &image.entries, MARK_ENTRY)) == SUCCESS &&
+       (res = index_names(&image)) == SUCCESS)
+        res = check_image(&image);
+
+    if(res == SUCCESS)
+    {
+        if((text.buf = malloc(DISASSEMBLY_BUFFER_SIZE)))
+            put_image(&text, &image);
+        else
+            res = ERR_MEM_ALLOC_FAILED;
+        free(text.buf);
+    }
+    *error_address = image.error_address;
+    *error_line = image.error_line;
+
+    free(image.words);
+    free(image.marks);
+    free(image.entries.text);
+    free(image.entries.names);
+    free(image.externals.text);
+    free(image.externals.names);
+    free(image.names);
+    free(image.name_kinds);
+    return res;
+}
@@ -0,0 +1,24 @@
+#ifndef _DISASSEMBLER_H
+#define _DISASSEMBLER_H
+
+#include <stdio.h>
+
+/* size of the chunks the object file is read in */
+#define OBJECT_READ_BUFFER_SIZE 65536
+
+/* size of the buffer the source text is formatted into before it's written */
+#define DISASSEMBLY_BUFFER_SIZE 65536
+
+/* longest .data line written, like the source lines the assembler reads */
+#define MAX_DATA_LINE_LEN 80
+
+/* address of the first word of every object file, the base of the code */
+#define OBJECT_BASE_ADDRESS 100
+
+/* number of values the opcode and funct fields of an instruction word can have */
+#define NUMBER_OF_OPCODES 64
+#define NUMBER_OF_FUNCTS 32
+
+int disassemble_object_file(char *file_path, FILE *out, unsigned long *error_address, unsigned long *error_line);
+
+#endif
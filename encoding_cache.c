@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "encoding_cache.h"
+#include "utilities.h"
+
+/*
+ * generated code repeats the same instruction lines over and over(inc r6, prn #48, mov r3, K...).
+ * the encoding of a line depends on nothing but its text, so the words and the symbols it uses are
+ * kept by the text and copied on the next time it's seen instead of reading it again.
+ * the symbols' words are left for the second pass like on any other line.
+ */
+
+encoding_cache_entry encoding_cache[ENCODING_CACHE_SIZE];
+
+/* lookups and hits since the stats were last reset */
+unsigned long encoding_cache_lookups = 0;
+unsigned long encoding_cache_hits = 0;
+
+/* write line to dst with no leading or trailing whitespaces and every other run of them as a single space.
+ * returns its length, 0 if it's too long to be cached. */
+int normalize_instruction_text(char *dst, char *line)
+{
+    unsigned int len = 0;
+
+    for(line = skip_whitespaces(line); *line; )
+    {
+        if(isspace(*line))
+        {
+            line = skip_whitespaces(line);
+            if(!*line)
+                break;
+            if(len == MAX_CACHED_INSTRUCTION_LEN)
+                return 0;
+            dst[len++] = ' ';
+        }
+        if(len == MAX_CACHED_INSTRUCTION_LEN)
+            return 0;
+        dst[len++] = *line++;
+    }
+    dst[len] = '\x0';
+    return len;
+}
+
+/* returns the cached encoding of the normalized text, NULL if it isn't cached */
+encoding_cache_entry *find_cached_encoding(char *text)
+{
+    encoding_cache_entry *entry = encoding_cache + hash_string(text) % ENCODING_CACHE_SIZE;
+
+    encoding_cache_lookups++;
+    if(strcmp(entry->text, text))
+        return NULL;
+    encoding_cache_hits++;
+    return entry;
+}
+
+/* keep the encoding of a line read successfully, in place of any other line in its slot */
+void cache_encoding(char *text, word *words, unsigned int number_of_words, int size, symbol_reference *references)
+{
+    encoding_cache_entry *entry = encoding_cache + hash_string(text) % ENCODING_CACHE_SIZE;
+
+    strcpy(entry->text, text);
+    memcpy(entry->words, words, number_of_words * sizeof(word));
+    entry->number_of_words = number_of_words;
+    entry->size = size;
+    memcpy(entry->references, references, MAX_REFERENCES * sizeof(symbol_reference));
+}
+
+void reset_encoding_cache_stats(void)
+{
+    encoding_cache_lookups = 0;
+    encoding_cache_hits = 0;
+}
+
+void print_encoding_cache_stats(char *file_path)
+{
+    printf(">> Encoding cache for \"%s\": %lu hits out of %lu instruction lines(%.1f%%)\n", file_path, encoding_cache_hits,
+           encoding_cache_lookups, encoding_cache_lookups ? 100.0 * encoding_cache_hits / encoding_cache_lookups : 0.0);
+}
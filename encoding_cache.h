@@ -0,0 +1,28 @@
+#ifndef _ENCODING_CACHE_H
+#define _ENCODING_CACHE_H
+
+#include "memory_map.h"
+#include "instructions_table.h"
+
+/* number of slots in the cache, a line replaces whatever was in its slot */
+#define ENCODING_CACHE_SIZE 1024
+
+/* longest normalized instruction text cached, longer lines are always read */
+#define MAX_CACHED_INSTRUCTION_LEN 63
+
+/* the encoding of an instruction line, before any symbol is resolved */
+typedef struct {
+    char text[MAX_CACHED_INSTRUCTION_LEN + 1]; /* normalized instruction text, empty for an unused slot */
+    word words[1 + MAX_OPERANDS]; /* the instruction word and operand words, symbols' words left zero */
+    unsigned int number_of_words; /* allocated for the instruction */
+    int size; /* of the encoded instruction */
+    symbol_reference references[MAX_REFERENCES]; /* unused ones have an empty name */
+} encoding_cache_entry;
+
+int normalize_instruction_text(char *dst, char *line);
+encoding_cache_entry *find_cached_encoding(char *text);
+void cache_encoding(char *text, word *words, unsigned int number_of_words, int size, symbol_reference *references);
+void reset_encoding_cache_stats(void);
+void print_encoding_cache_stats(char *file_path);
+
+#endif
@@ -48,6 +48,16 @@ char *error_code_to_string(int error_code)
             return "number too big for 21-bit integer";
         case ERR_MISSING_VALUE:
             return "missing value";
+        case ERR_INVALID_INCLUDE:
+            return "only .data, .string, .incbin and .extern can be included";
+        case ERR_INVALID_INSTRUCTION_WORD:
+            return "word is not a valid instruction";
+        case ERR_INVALID_OBJECT_FILE:
+            return "invalid object file";
+        case ERR_INVALID_ARCHIVE:
+            return "invalid archive";
+        case ERR_INVALID_OPTION:
+            return "invalid option";
         default:
             return "unknown error code";
     }
@@ -24,11 +24,17 @@
 #define ERR_INT24_OVERFLOW -19
 #define ERR_INT21_OVERFLOW -20
 #define ERR_MISSING_VALUE -21
+#define ERR_INVALID_INCLUDE -22
+#define ERR_INVALID_INSTRUCTION_WORD -23
 
 #define ERR_NOT_GUIDE_STATEMENT -30
 #define ERR_INVALID_GUIDE -31
 
 #define ERR_COULD_NOT_OPEN_FILE -40
+#define ERR_INVALID_OBJECT_FILE -41
+#define ERR_INVALID_ARCHIVE -42
+
+#define ERR_INVALID_OPTION -50
 
 char *error_code_to_string(int error_code);
 
@@ -5,6 +5,8 @@
 #include "linked_list.h"
 #include "errors.h"
 #include "utilities.h"
+#include "archive.h"
+#include "alloc_tracking.h"
 
 /* add new external("extern") symbol to list. returns SUCCESS if succeeded, error code otherwise. */
 int add_external_item(externals_table *external_symbols, char *name, unsigned int address)
@@ -41,7 +43,7 @@ int write_externals_file(char *file_path, externals_table *external_symbols)
     external_item *curr_item;
 
     sprintf((char *)&name, "%s.ext", file_path);
-    fh = fopen(name, "w");
+    fh = open_output_file(name, "w");
     if(fh)
     {
         while(curr_node)
@@ -51,7 +53,8 @@ int write_externals_file(char *file_path, externals_table *external_symbols)
             number_of_lines_written++;
             curr_node = curr_node->next;
         }
-        fclose(fh);
+        if(close_output_file(fh) != 0)
+            number_of_lines_written = 0;
     }
     return number_of_lines_written;
 }
@@ -2,20 +2,43 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <errno.h>
 
 #include "utilities.h"
 #include "instructions_table.h"
 #include "symbols_table.h"
 #include "memory_map.h"
 #include "errors.h"
+#include "incbin.h"
+#include "include.h"
+#include "encoding_cache.h"
+#include "options.h"
+#include "first_pass.h"
+#include "alloc_tracking.h"
+
+/* initial number of items allocated for a data declaration, doubled whenever it runs out */
+#define DATA_INITIAL_CAPACITY 16
+
+/* save the symbol used by a direct/relative operand so it could be resolved on the second pass */
+void add_symbol_reference(symbol_reference *dst, unsigned int word_offset, int addressing_method, char *operand)
+{
+    operand = skip_whitespaces(operand);
+    if(addressing_method == ADDR_RELATIVE)
+        operand++; /* skip '&' char */
+
+    dst->word_offset = word_offset;
+    dst->addressing_method = addressing_method;
+    strncpy(dst->symbol_name, operand, MAX_LABEL_LEN);
+    dst->symbol_name[MAX_LABEL_LEN] = '\x0';
+}
 
 /* read operands from string. returns total size of encoded instruction on success, error code otherwise. */
-int read_operands(instruction *inst, int instruction_id, word *opt_operands, char *operands_str)
+int read_operands(word *inst, int instruction_id, word *opt_operands, symbol_reference *references, char *operands_str)
 {
     int res = SUCCESS;
-    int number_of_operands_found, size = 1;
+    int number_of_operands_found, size = 1, number_of_references = 0;
     char operand1[LINE_MAX], operand2[LINE_MAX];
-    int source_addressing_method, dest_addressing_method;
+    int source_addressing_method, dest_addressing_method, reg;
     char *dest_operand_str = operand1;
 
     /* try to split the operands string */
@@ -33,19 +56,21 @@ int read_operands(instruction *inst, int instruction_id, word *opt_operands, cha
             /* make sure this addressing method is supported by the instruction */
             if(is_source_addressing_method_supported(instruction_id, source_addressing_method))
             {
-                inst->source_addressing_method = source_addressing_method;
+                inst->val |= (unsigned long)source_addressing_method << SRC_ADDR_SHIFT;
                 switch (source_addressing_method)
                 {
                     case ADDR_REG_DIRECT:
-                        if((inst->source_register = read_reg_number(operand1)) < 0)
+                        if((reg = read_reg_number(operand1)) < 0)
                             res = ERR_INVALID_REG_NAME;
+                        else
+                            inst->val |= (unsigned long)reg << SRC_REG_SHIFT;
                         break;
 
                     case ADDR_IMMEDIATE:
-                        res = read_int21(skip_whitespaces(operand1) + 1, (data_word *)opt_operands);
+                        res = read_int21(skip_whitespaces(operand1) + 1, opt_operands);
                         if(res == SUCCESS)
                         {
-                            set_flags_absolute((data_word *)opt_operands);
+                            set_flags_absolute(opt_operands);
                             size++;
                             opt_operands++;
                         }
@@ -58,6 +83,7 @@ int read_operands(instruction *inst, int instruction_id, word *opt_operands, cha
                     case ADDR_RELATIVE:
                     case ADDR_DIRECT:
                         /* forward for the destination operand */
+                        add_symbol_reference(references + number_of_references++, size, source_addressing_method, operand1);
                         opt_operands++;
                         size++;
                         break;
@@ -76,20 +102,22 @@ int read_operands(instruction *inst, int instruction_id, word *opt_operands, cha
             dest_addressing_method = read_addressing_method(dest_operand_str);
             if(is_dest_addressing_method_supported(instruction_id, dest_addressing_method))
             {
-                inst->dest_addressing_method = dest_addressing_method;
+                inst->val |= (unsigned long)dest_addressing_method << DEST_ADDR_SHIFT;
                 switch (dest_addressing_method)
                 {
                     case ADDR_REG_DIRECT:
-                        if((inst->dest_register = read_reg_number(dest_operand_str)) < 0)
+                        if((reg = read_reg_number(dest_operand_str)) < 0)
                             res = ERR_INVALID_REG_NAME;
+                        else
+                            inst->val |= (unsigned long)reg << DEST_REG_SHIFT;
                         break;
 
                     case ADDR_IMMEDIATE:
                         /* read value as 21 bits long integer */
-                        res = read_int21(skip_whitespaces(dest_operand_str) + 1, (data_word *)opt_operands);
+                        res = read_int21(skip_whitespaces(dest_operand_str) + 1, opt_operands);
                         if(res == SUCCESS)
                         {
-                            set_flags_absolute((data_word *)opt_operands); /* set ARE flags */
+                            set_flags_absolute(opt_operands); /* set ARE flags */
                             size++;
                         }
                         else
@@ -99,6 +127,7 @@ int read_operands(instruction *inst, int instruction_id, word *opt_operands, cha
                         break;
                     case ADDR_RELATIVE:
                     case ADDR_DIRECT: /* we'll only save space for relative and direct addressing mode operands */
+                        add_symbol_reference(references + number_of_references++, size, dest_addressing_method, dest_operand_str);
                         size++;
                         break;
                 }
@@ -116,24 +145,38 @@ int read_operands(instruction *inst, int instruction_id, word *opt_operands, cha
     return res >= 0 ? size : res;
 }
 
-/* read instruction name and operands from strings and decode to dst */
-int read_instruction_name_and_operands(word **dst, char *instruction_name_str, char *operands_str)
+/* read instruction name and operands from strings and decode to dst(or only check them for NULL), symbols used by the operands are saved to references */
+int read_instruction_name_and_operands(word **dst, symbol_reference *references, char *instruction_name_str, char *operands_str)
 {
     int res = ERR_INSTRUCTION_NOT_FOUND;
-    unsigned short instruction_id = get_instruction_id(instruction_name_str);
+    int instruction_id = get_instruction_id(instruction_name_str);
+    word scratch[1 + MAX_OPERANDS], *words = scratch;
 
     if(instruction_id >= 0)
     {
         /* allocate zero initialized memory for decoded instruction & optional data words */
-        *dst = (word *)calloc(1 + get_number_of_operands(instruction_id), sizeof(word));
-        if(*dst)
+        if(dst)
+            words = (word *)calloc(1 + get_number_of_operands(instruction_id), sizeof(word));
+        else
+            memset(scratch, 0, sizeof(scratch));
+
+        if(words)
         {
             /* decoded instruction and operands */
-            init_instruction((instruction *)*dst, instruction_id);
+            init_instruction(words, instruction_id);
             if(*skip_whitespaces(operands_str)) /* avoid no-operands instructions */
-                res = read_operands((instruction *)*dst, instruction_id, *dst + 1, operands_str);
+                res = read_operands(words, instruction_id, words + 1, references, operands_str);
             else
                 res = 1;
+
+            /* nobody will keep the words of a bad instruction */
+            if(dst && res < 0)
+            {
+                free(words);
+                words = NULL;
+            }
+            if(dst)
+                *dst = words;
         }
         else
         {
@@ -143,10 +186,29 @@ int read_instruction_name_and_operands(word **dst, char *instruction_name_str, c
     return res;
 }
 
-/* read instruction line and decode to dst */
-int read_instruction_line(word **dst, char *line)
+/* read instruction line and decode to dst. references must have room for MAX_REFERENCES, unused ones are left with empty name */
+int read_instruction_line(word **dst, symbol_reference *references, char *line)
 {
+    int i, res, cacheable;
     char *instruction_name_str, *operands_str = NULL;
+    char text[MAX_CACHED_INSTRUCTION_LEN + 1];
+    encoding_cache_entry *cached;
+
+    /* copy the encoding of a line seen before */
+    if((cacheable = normalize_instruction_text(text, line)) && (cached = find_cached_encoding(text)))
+    {
+        if(dst)
+        {
+            if(!(*dst = (word *)malloc(cached->number_of_words * sizeof(word))))
+                return ERR_MEM_ALLOC_FAILED;
+            memcpy(*dst, cached->words, cached->number_of_words * sizeof(word));
+        }
+        memcpy(references, cached->references, MAX_REFERENCES * sizeof(symbol_reference));
+        return cached->size;
+    }
+
+    for(i = 0; i < MAX_REFERENCES; i++)
+        references[i].symbol_name[0] = '\x0';
 
     /* skip prepended spaces(if any) */
     line = skip_whitespaces(line);
@@ -162,79 +224,92 @@ int read_instruction_line(word **dst, char *line)
     }
 
     /* continue processing current line */
-    return read_instruction_name_and_operands(dst, instruction_name_str, operands_str);
+    res = read_instruction_name_and_operands(dst, references, instruction_name_str, operands_str);
+
+    /* only lines which were read into words can be cached */
+    if(res > 0 && dst && cacheable)
+        cache_encoding(text, *dst, 1 + get_number_of_operands(get_instruction_id(instruction_name_str)), res, references);
+    return res;
 }
 
-/* read a single data declaration line and decode it into pre-allocated buf */
-int read_data_declaration_inner(word *buf, char *data_str)
+/* read a single data declaration line and decode it into dst(or only check it for NULL), in a single pass and with no limit on number of items */
+int read_data_declaration(word **dst, char *data_str)
 {
-    int res = SUCCESS;
-    char *start = data_str, *end;
-    int count = 0;
-    word tmp;
+    int res;
+    unsigned int count = 0, capacity = DATA_INITIAL_CAPACITY;
+    char *end = data_str + strlen(data_str);
+    word *buf, *tmp, scratch;
 
-    do
+    if(!dst)
     {
-        start = skip_whitespaces(start);
+        /* every item is read into the same word */
+        do
+        {
+            if((res = read_int24_item(&data_str, end, &scratch)) != SUCCESS)
+                return res;
+            count++;
+        } while(data_str++ != end);
+        return count;
+    }
 
-        /* check if any more number */
-        if((end = strchr(start, ',')))
-            *end = '\x0'; /* split the string */
+    if(!(buf = malloc(capacity * sizeof(word))))
+        return ERR_MEM_ALLOC_FAILED;
 
-        if(!strlen(start))
-        {
-            /* no value to read */
-            res = ERR_MISSING_VALUE;
-            break;
-        }
-        else if((res = read_int24(start, &tmp)) != SUCCESS)
+    do
+    {
+        /* make room for one more item */
+        if(count == capacity)
         {
-            /* not a valid decimal number */
-            break;
+            if(!(tmp = realloc(buf, (capacity *= 2) * sizeof(word))))
+            {
+                res = ERR_MEM_ALLOC_FAILED;
+                break;
+            }
+            buf = tmp;
         }
-        /* save current value */
-        buf[count].val = tmp.val;
 
-        /* forward the string start pointer */
-        start = end;
+        /* read the value straight into its place */
+        if((res = read_int24_item(&data_str, end, buf + count)) != SUCCESS)
+            break;
         count++;
-    } while(start++);
-    return res != SUCCESS ? res : count;
+    } while(data_str++ != end); /* stop on the null terminator, otherwise skip the comma */
+
+    if(res != SUCCESS)
+    {
+        free(buf); /* free this buffer because it wont be used */
+        return res;
+    }
+    *dst = buf;
+    return count;
 }
 
-/* allocate memory and read a single data declaration line and decode it into dst */
-int read_data_declaration(word **dst, char *data_str)
+/* read a single .space declaration(number of words and an optional value, 0 by default) into dst, the single word
+ * all the reserved words have(or only check it for NULL). returns number of words on success, error code otherwise. */
+int read_space_declaration(word **dst, char *data_str)
 {
-    int res = 0;
-    unsigned int expected_number_of_items;
-    word *buf;
+    char *end = data_str + strlen(data_str);
+    word count, value;
+    int res;
 
-    /* count how many commas we got so we know how many data items should be */
-    expected_number_of_items = count_occurrences(',', data_str) + 1;
-    buf = calloc(expected_number_of_items, sizeof(word));
-    if(buf)
-    {
-        /* read and make sure the we got the right number of items */
-        res = read_data_declaration_inner(buf, data_str);
-        if (res == expected_number_of_items)
-        {
-            *dst = buf;
-        }
-        else
-        {
-            if(res > 0)
-                res = ERR_INVALID_VALUE;
-            free(buf); /* free this buffer because it wont be used */
-        }
-    }
-    else
-    {
-        res = ERR_MEM_ALLOC_FAILED;
-    }
-    return res;
+    if((res = read_int24_item(&data_str, end, &count)) != SUCCESS)
+        return res;
+    if(!count.val || count.val > MAX_SPACE_WORDS)
+        return ERR_VALUE_OUT_OF_RANGE; /* also catches negative counts, their 24-bit form is above the max */
+
+    /* the value, if given, follows a comma */
+    value.val = 0;
+    if(data_str != end && (data_str++, (res = read_int24_item(&data_str, end, &value)) != SUCCESS || data_str != end))
+        return res == SUCCESS ? ERR_INVALID_SYNTAX : res;
+
+    if(!dst)
+        return count.val;
+    if(!(*dst = malloc(sizeof(word))))
+        return ERR_MEM_ALLOC_FAILED;
+    **dst = value;
+    return count.val;
 }
 
-/* read a single string declaration line and decode it into dst */
+/* read a single string declaration line and decode it into dst(or only check it for NULL) */
 int read_string_declaration(word **dst, char *data_str)
 {
     int res = ERR_INVALID_SYNTAX;
@@ -247,11 +322,13 @@ int read_string_declaration(word **dst, char *data_str)
         /* find closing comma and make sure its the last char */
         if ((end = strchr(++start, '"')) && !*skip_whitespaces(end + 1))
         {
-            *end = '\x0'; /* split the string */
-            buf = calloc((end - start) + 1, sizeof(word)); /* allocate zero initialized memory */
+            if(!dst)
+                return (end - start) + 1; /* the chars & null terminator */
+
+            buf = malloc(((end - start) + 1) * sizeof(word));
             if(buf)
             {
-                res = chars_to_words(buf, start); /* read the chars to words buffer */
+                res = chars_to_words(buf, start, end - start); /* read the chars to words buffer */
                 *dst = buf;
             }
             else
@@ -263,6 +340,69 @@ int read_string_declaration(word **dst, char *data_str)
     return res;
 }
 
+/* read a non-negative decimal number of an .incbin declaration, moves s after it. returns SUCCESS on success, error code otherwise. */
+int read_incbin_number(char **s, long *dst)
+{
+    char *end;
+
+    /* numbers must follow a comma */
+    *s = skip_whitespaces(*s);
+    if(**s != ',')
+        return ERR_INVALID_SYNTAX;
+    *s = skip_whitespaces(*s + 1);
+    if(!isdigit(**s))
+        return ERR_ILLEGAL_CHAR;
+
+    errno = 0;
+    *dst = strtol(*s, &end, 10);
+    if(errno == ERANGE)
+        return ERR_VALUE_OUT_OF_RANGE;
+    *s = end;
+    return SUCCESS;
+}
+
+/* read a single binary include line("file"[, offset, length]) and decode the file contents into dst(or only check it for NULL) */
+int read_incbin_declaration(word **dst, char *data_str)
+{
+    int res = ERR_INVALID_SYNTAX;
+    char *start, *end;
+    long offset = 0, length = INCBIN_TO_END;
+
+    /* split the file path between the quotation marks */
+    if(*(start = skip_whitespaces(data_str)) == '"' && (end = strchr(++start, '"')) && end != start)
+    {
+        *end++ = '\x0';
+        res = SUCCESS;
+
+        /* read the optional range */
+        if(*skip_whitespaces(end))
+        {
+            if((res = read_incbin_number(&end, &offset)) == SUCCESS && *skip_whitespaces(end))
+                res = read_incbin_number(&end, &length);
+            if(res == SUCCESS && *skip_whitespaces(end))
+                res = ERR_LEFTOVER;
+        }
+
+        if(res == SUCCESS)
+            res = read_binary_file(dst, start, offset, length, options.incbin_bytes_per_word);
+    }
+    return res;
+}
+
+/* read a single include line("file") and splice the words of the file into dst(or only count them for NULL) and its symbols into symbols */
+int read_include_declaration(word **dst, char *data_str, symbol_table *symbols)
+{
+    char *start, *end;
+
+    /* split the file path between the quotation marks */
+    if(*(start = skip_whitespaces(data_str)) != '"' || !(end = strchr(++start, '"')) || end == start)
+        return ERR_INVALID_SYNTAX;
+    *end++ = '\x0';
+    if(*skip_whitespaces(end))
+        return ERR_LEFTOVER;
+    return splice_included_file(dst, start, symbols);
+}
+
 /* read a single external declaration line and add to symbols table */
 int read_extern_declaration(char *buf, symbol_table *symbols)
 {
@@ -282,7 +422,7 @@ int read_extern_declaration(char *buf, symbol_table *symbols)
     return res;
 }
 
-/* read a single guide line and decode it into dst */
+/* read a single guide line and decode it into dst(or only check it for NULL) */
 int read_guide_line(word **dst, char *line, symbol_table *symbols)
 {
     int res = ERR_INVALID_SYNTAX;
@@ -295,8 +435,9 @@ int read_guide_line(word **dst, char *line, symbol_table *symbols)
     /* split the declaration type string */
     declaration_type = skip_whitespaces(line);
     line = skip_word(line);
-    *line = '\x0';
-    line = skip_whitespaces(++line);
+    if(*line) /* a bare declaration type ends the line, don't step past it */
+        *line++ = '\x0';
+    line = skip_whitespaces(line);
 
     /* read declaration by its type */
     if (STARTS_WITH(declaration_type, "data"))
@@ -307,6 +448,18 @@ int read_guide_line(word **dst, char *line, symbol_table *symbols)
     {
         res = read_string_declaration(dst, line);
     }
+    else if (STARTS_WITH(declaration_type, "incbin"))
+    {
+        res = read_incbin_declaration(dst, line);
+    }
+    else if (STARTS_WITH(declaration_type, "include"))
+    {
+        res = read_include_declaration(dst, line, symbols);
+    }
+    else if (STARTS_WITH(declaration_type, "space"))
+    {
+        res = read_space_declaration(dst, line);
+    }
     else if (STARTS_WITH(declaration_type, "entry"))
     {
         res = 0; /* we'll handle it on the second pass */
@@ -322,11 +475,14 @@ int read_guide_line(word **dst, char *line, symbol_table *symbols)
 int process_line(char *line, unsigned int line_number, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols)
 {
     char *label = NULL;
-    int res, tmp;
+    int res, tmp, is_space;
     unsigned int label_address = 0;
     word *machine_code;
+    symbol_reference references[MAX_REFERENCES];
+    unsigned int number_of_references;
     symbol_type type = data;
     char *sep;
+    node *last_symbol = symbols->symbols.tail, *curr;
     /* check for label at the start of this line */
     if((sep = strchr(line, ':')))
     {
@@ -338,20 +494,31 @@ int process_line(char *line, unsigned int line_number, memory_segment *code_segm
     /* quickly check if this is a guide line, further check will be made afterwards */
     if(*line == '.')
     {
-        /* read as guide line */
+        /* read as guide line, a .space reservation is kept as a single word until it's written */
+        is_space = read_guide_statement_type(line) == GUIDE_SPACE;
         res = read_guide_line(&machine_code, line, symbols);
         if(res > 0)
         {
             /* save to data segment */
-            res = add_memory_item(data_segment, res, machine_code, line_number);
+            if(is_space)
+                res = add_memory_run(data_segment, res, machine_code, line_number);
+            else
+                res = add_memory_item(data_segment, res, machine_code, line_number);
             if(res)
                 label_address = res;
+
+            /* labels of an included file are relative to its first word */
+            for(curr = last_symbol ? last_symbol->next : symbols->symbols.head; curr && res > 0; curr = curr->next)
+            {
+                if(((symbol_entry *)curr->data)->type == data)
+                    ((symbol_entry *)curr->data)->offset += label_address - data_segment->base_address;
+            }
         }
     }
     else
     {
         /* read as code/instruction line */
-        res = read_instruction_line(&machine_code, line);
+        res = read_instruction_line(&machine_code, references, line);
         if(res > 0)
         {
             /* save to code segment */
@@ -359,6 +526,11 @@ int process_line(char *line, unsigned int line_number, memory_segment *code_segm
             if(res)
                 label_address = res;
             type = code;
+
+            /* keep the symbols used by the operands for the second pass */
+            for(number_of_references = 0; number_of_references < MAX_REFERENCES && references[number_of_references].symbol_name[0]; number_of_references++);
+            if(res > 0 && (tmp = set_memory_item_references(get_tail(&code_segment->items), references, number_of_references)) != SUCCESS)
+                res = tmp;
         }
     }
 
@@ -369,20 +541,25 @@ int process_line(char *line, unsigned int line_number, memory_segment *code_segm
         if(tmp != SUCCESS)
             res = tmp;
     }
+
+    /* remember where the new symbols(label or external) were defined */
+    for(curr = last_symbol ? last_symbol->next : symbols->symbols.head; curr; curr = curr->next)
+        ((symbol_entry *)curr->data)->line_number = line_number;
     return res;
 }
 
 /* process the file for the first time and decode what we can. returns number of error(lines) found in the file. */
 int first_pass(FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols)
 {
-    char buf[LINE_MAX];
-    char *line = buf;
+    char *buf = NULL;
+    unsigned int buf_size = 0;
+    char *line;
     int res;
     unsigned line_number = 1;
     int number_of_errors = 0;
 
     /* read and process one line at a time */
-    while(fgets((char *)&buf, LINE_MAX, fh))
+    while(read_line(fh, &buf, &buf_size))
     {
         /* skip blank lines and comments */
         if(*(line = skip_whitespaces(buf)) && *line != ';')
@@ -396,5 +573,6 @@ int first_pass(FILE *fh, memory_segment *code_segment, memory_segment *data_segm
         }
         line_number++;
     }
+    free(buf);
     return number_of_errors;
 }
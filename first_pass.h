@@ -1,5 +1,17 @@
+#ifndef _FIRST_PASS_H
+#define _FIRST_PASS_H
+
+#include <stdio.h>
+
 #include "memory_map.h"
 #include "symbols_table.h"
 
+/* most words a single .space declaration can reserve, the largest positive 24-bit count */
+#define MAX_SPACE_WORDS ((1UL << 23) - 1)
+
+int read_instruction_line(word **dst, symbol_reference *references, char *line);
+int read_guide_line(word **dst, char *line, symbol_table *symbols);
+int process_line(char *line, unsigned int line_number, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols);
 int first_pass(FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols);
 
+#endif
@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "gc.h"
+#include "memory_map.h"
+#include "symbols_table.h"
+#include "instructions_table.h"
+#include "utilities.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/* a run of items starting at a label(or at the start of the segment) up to the next label */
+typedef struct {
+    unsigned int start; /* relative address of the first word */
+    node *first_node;
+    unsigned int labeled:1;
+    unsigned int reachable:1;
+    unsigned int falls_through:1; /* execution might continue into the next block */
+} block;
+
+typedef struct {
+    memory_segment *segment;
+    symbol_type type;
+    unsigned int number_of_blocks;
+    block *blocks;
+    unsigned int number_of_items;
+    unsigned int *starts; /* of every item, the tables of the segment have an entry per item and not per word */
+} segment_blocks;
+
+/* work list of blocks waiting to be scanned */
+typedef struct {
+    unsigned int size;
+    block **items;
+} block_stack;
+
+/* ids of the instructions execution never continues after */
+typedef struct {
+    int jmp;
+    int rts;
+    int stop;
+} flow_instructions;
+
+/* returns non-zero if execution never continues after this instruction */
+int ends_flow(flow_instructions *ids, unsigned long val)
+{
+    int id = decode_instruction_id(val);
+    return id == ids->jmp || id == ids->rts || id == ids->stop;
+}
+
+/* split a segment into blocks at its labels. returns SUCCESS on success, error code otherwise. */
+int split_to_blocks(segment_blocks *dst, memory_segment *segment, symbol_type type, symbol_table *symbols, flow_instructions *ids)
+{
+    char *labeled;
+    node *curr;
+    memory_item *item;
+    block *last = NULL;
+    unsigned int i;
+
+    dst->segment = segment;
+    dst->type = type;
+    dst->number_of_blocks = 0;
+    dst->starts = index_memory_items(segment, &dst->number_of_items);
+    dst->blocks = malloc((dst->number_of_items + 1) * sizeof(block)); /* never more blocks than items */
+    labeled = malloc(dst->number_of_items + 1);
+    if(!dst->starts || !dst->blocks || !labeled)
+    {
+        free(labeled);
+        return ERR_MEM_ALLOC_FAILED;
+    }
+
+    mark_symbols_items(labeled, symbols, type, segment->base_address, dst->starts, dst->number_of_items);
+    for(i = 0, curr = segment->items.head; curr; curr = curr->next, i++)
+    {
+        item = (memory_item *)curr->data;
+        if(!last || labeled[i])
+        {
+            last = dst->blocks + dst->number_of_blocks++;
+            last->start = item->relative_address;
+            last->first_node = curr;
+            last->labeled = labeled[i];
+            last->reachable = 0;
+        }
+        last->falls_through = type == code && !ends_flow(ids, item->data->val);
+    }
+    free(labeled);
+    return SUCCESS;
+}
+
+/* find the block containing an absolute address */
+block *find_block(segment_blocks *blocks, unsigned int address)
+{
+    unsigned int low = 0, high = blocks->number_of_blocks, middle;
+
+    if(!blocks->number_of_blocks || address < blocks->segment->base_address)
+        return NULL;
+    address -= blocks->segment->base_address;
+
+    /* last block that starts at or before the address */
+    while(high - low > 1)
+    {
+        middle = (low + high) / 2;
+        if(blocks->blocks[middle].start <= address)
+            low = middle;
+        else
+            high = middle;
+    }
+    return blocks->blocks + low;
+}
+
+/* mark a block as reachable and queue it to be scanned(if it wasn't already and there's a stack to queue it to) */
+void reach(block_stack *stack, block *target)
+{
+    if(target && !target->reachable)
+    {
+        target->reachable = 1;
+        if(stack)
+            stack->items[stack->size++] = target;
+    }
+}
+
+/* mark the block a symbol is defined in as reachable */
+void reach_symbol(block_stack *stack, segment_blocks *code_blocks, segment_blocks *data_blocks, symbol_table *symbols, symbol_entry *symbol)
+{
+    if(symbol && symbol->type == code)
+        reach(stack, find_block(code_blocks, symbol_address(symbols, symbol)));
+    else if(symbol && symbol->type == data)
+        reach(NULL, find_block(data_blocks, symbol_address(symbols, symbol))); /* data blocks don't refer to anything, no need to scan them */
+}
+
+/* add all the symbols of .entry statements as roots */
+void reach_entries(FILE *fh, block_stack *stack, segment_blocks *code_blocks, segment_blocks *data_blocks, symbol_table *symbols)
+{
+    char *buf = NULL, *line, *end;
+    unsigned int buf_size = 0;
+
+    rewind(fh);
+    while(read_line(fh, &buf, &buf_size))
+    {
+        line = skip_whitespaces(skip_label(skip_whitespaces(buf)));
+        if(read_guide_statement_type(line) == GUIDE_ENTRY)
+        {
+            /* skip '.entry' word and trim the label */
+            line = skip_whitespaces(line + 6);
+            for(end = line; *end && !isspace(*end); end++);
+            *end = '\x0';
+            reach_symbol(stack, code_blocks, data_blocks, symbols, resolve_symbol(symbols, line));
+        }
+    }
+    free(buf);
+    rewind(fh);
+}
+
+/* scan reachable blocks, following the operands symbols and the flow of execution into the next block.
+ * returns SUCCESS on success, or ERR_MISSING_SYMBOL if some symbol can't be resolved yet */
+int scan_blocks(block_stack *stack, segment_blocks *code_blocks, segment_blocks *data_blocks, symbol_table *symbols)
+{
+    block *curr;
+    node *curr_node, *end_node;
+    memory_item *item;
+    symbol_entry *symbol;
+    unsigned int i;
+
+    while(stack->size)
+    {
+        curr = stack->items[--stack->size];
+        end_node = curr + 1 < code_blocks->blocks + code_blocks->number_of_blocks ? (curr + 1)->first_node : NULL;
+        for(curr_node = curr->first_node; curr_node != end_node; curr_node = curr_node->next)
+        {
+            item = (memory_item *)curr_node->data;
+            for(i = 0; i < item->number_of_references; i++)
+            {
+                if(!(symbol = resolve_symbol(symbols, item->references[i].symbol_name)))
+                    return ERR_MISSING_SYMBOL;
+                reach_symbol(stack, code_blocks, data_blocks, symbols, symbol);
+            }
+        }
+
+        if(curr->falls_through && end_node)
+            reach(stack, curr + 1);
+    }
+    return SUCCESS;
+}
+
+/* mark the items of all the labeled blocks nobody reached for removal. returns number of blocks dropped */
+unsigned int drop_unreachable_blocks(segment_blocks *blocks)
+{
+    unsigned int i, dropped = 0;
+    node *curr_node, *end_node;
+
+    for(i = 0; i < blocks->number_of_blocks; i++)
+    {
+        if(blocks->blocks[i].reachable || !blocks->blocks[i].labeled)
+            continue;
+
+        end_node = i + 1 < blocks->number_of_blocks ? blocks->blocks[i + 1].first_node : NULL;
+        for(curr_node = blocks->blocks[i].first_node; curr_node != end_node; curr_node = curr_node->next)
+            mark_memory_item_removed((memory_item *)curr_node->data);
+        dropped++;
+    }
+    return dropped;
+}
+
+/* remove a segment dropped items and move its symbols accordingly. returns number of words removed */
+unsigned int compact_blocks(segment_blocks *blocks, symbol_table *symbols)
+{
+    unsigned int removed = 0;
+    unsigned int *relocation = malloc((blocks->number_of_items + 1) * sizeof(unsigned int));
+
+    if(relocation)
+    {
+        removed = compact_memory_segment(blocks->segment, relocation);
+        relocate_symbols(symbols, blocks->type, blocks->segment->base_address, blocks->starts, blocks->number_of_items, relocation);
+        free(relocation);
+    }
+    return removed;
+}
+
+/* drop labeled code and data blocks which can't be reached from the entries, the start label(if given) or the start of the
+ * code. must run after the first pass and before data symbols get their final address. returns number of words removed on
+ * success, error code otherwise(in which case nothing is removed). */
+int collect_unreachable_items(FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, char *start_label)
+{
+    int res;
+    segment_blocks code_blocks, data_blocks;
+    block_stack stack;
+    symbol_entry *start;
+    flow_instructions ids;
+
+    ids.jmp = get_instruction_id("jmp");
+    ids.rts = get_instruction_id("rts");
+    ids.stop = get_instruction_id("stop");
+
+    code_blocks.starts = NULL;
+    data_blocks.blocks = NULL;
+    data_blocks.starts = NULL;
+    stack.items = NULL;
+    if((res = split_to_blocks(&code_blocks, code_segment, code, symbols, &ids)) == SUCCESS &&
+       (res = split_to_blocks(&data_blocks, data_segment, data, symbols, &ids)) == SUCCESS)
+    {
+        /* every code block is pushed at most once */
+        stack.size = 0;
+        if(!(stack.items = malloc((code_blocks.number_of_blocks + 1) * sizeof(block *))))
+            res = ERR_MEM_ALLOC_FAILED;
+    }
+
+    if(res == SUCCESS)
+    {
+        /* execution starts at the start label if given, otherwise at the start of the code */
+        if(start_label)
+        {
+            if((start = resolve_symbol(symbols, start_label)))
+                reach_symbol(&stack, &code_blocks, &data_blocks, symbols, start);
+            else
+                res = ERR_MISSING_SYMBOL;
+        }
+        else if(code_blocks.number_of_blocks)
+        {
+            reach(&stack, code_blocks.blocks);
+        }
+        reach_entries(fh, &stack, &code_blocks, &data_blocks, symbols);
+
+        if(res == SUCCESS && (res = scan_blocks(&stack, &code_blocks, &data_blocks, symbols)) == SUCCESS)
+        {
+            res = 0;
+            if(drop_unreachable_blocks(&code_blocks))
+                res += compact_blocks(&code_blocks, symbols);
+            if(drop_unreachable_blocks(&data_blocks))
+                res += compact_blocks(&data_blocks, symbols);
+        }
+    }
+
+    free(code_blocks.blocks);
+    free(data_blocks.blocks);
+    free(code_blocks.starts);
+    free(data_blocks.starts);
+    free(stack.items);
+    return res;
+}
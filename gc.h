@@ -0,0 +1,11 @@
+#ifndef _GC_H
+#define _GC_H
+
+#include <stdio.h>
+
+#include "memory_map.h"
+#include "symbols_table.h"
+
+int collect_unreachable_items(FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, char *start_label);
+
+#endif
@@ -0,0 +1,78 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "incbin.h"
+#include "memory_map.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/* pack the bytes into words, bytes_per_word bytes(most significant first) per word. last word is padded with zeros. */
+unsigned int bytes_to_words(word *dst, unsigned char *src, unsigned long length, unsigned int bytes_per_word)
+{
+    unsigned long i;
+    unsigned int count = 0;
+
+    if(bytes_per_word == 1)
+    {
+        for(i = 0; i < length; i++)
+            dst[i].val = src[i];
+        return length;
+    }
+
+    for(i = 0; i + 3 <= length; i += 3)
+        dst[count++].val = ((unsigned long)src[i] << 16) | ((unsigned long)src[i + 1] << 8) | src[i + 2];
+
+    /* leftover bytes */
+    if(i < length)
+        dst[count++].val = ((unsigned long)src[i] << 16) | (i + 1 < length ? (unsigned long)src[i + 1] << 8 : 0);
+    return count;
+}
+
+/* map a binary file and decode the range [offset, offset + length) of it into dst(or only check it for NULL).
+ * returns number of words on success, error code otherwise. */
+int read_binary_file(word **dst, char *file_path, long offset, long length, unsigned int bytes_per_word)
+{
+    int res = ERR_COULD_NOT_OPEN_FILE;
+    int fd;
+    struct stat st;
+    unsigned char *mapped;
+    unsigned long number_of_words;
+
+    if((fd = open(file_path, O_RDONLY)) < 0)
+        return res;
+
+    if(fstat(fd, &st) == 0)
+    {
+        /* offset is checked first so the range is computed without overflowing */
+        if(offset >= 0 && offset <= st.st_size && length == INCBIN_TO_END)
+            length = st.st_size - offset;
+
+        /* make sure the range is inside the file and not empty */
+        if(offset < 0 || offset > st.st_size || length <= 0 || length > st.st_size - offset ||
+           length / bytes_per_word >= INT_MAX)
+        {
+            res = ERR_VALUE_OUT_OF_RANGE;
+        }
+        else if(!dst)
+        {
+            res = (length + bytes_per_word - 1) / bytes_per_word;
+        }
+        else if((mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED)
+        {
+            number_of_words = (length + bytes_per_word - 1) / bytes_per_word;
+            if((*dst = malloc(number_of_words * sizeof(word))))
+                res = bytes_to_words(*dst, mapped + offset, length, bytes_per_word);
+            else
+                res = ERR_MEM_ALLOC_FAILED;
+            munmap(mapped, st.st_size);
+        }
+    }
+    close(fd);
+    return res;
+}
@@ -0,0 +1,11 @@
+#ifndef _INCBIN_H
+#define _INCBIN_H
+
+#include "memory_map.h"
+
+/* read the whole file from the offset */
+#define INCBIN_TO_END -1
+
+int read_binary_file(word **dst, char *file_path, long offset, long length, unsigned int bytes_per_word);
+
+#endif
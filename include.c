@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include.h"
+#include "first_pass.h"
+#include "memory_map.h"
+#include "symbols_table.h"
+#include "linked_list.h"
+#include "utilities.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/*
+ * files included with .include hold only .extern declarations and data(.data, .string & .incbin).
+ * each one is parsed once into its words and symbols, and every later .include of the same contents
+ * copies them instead of parsing again, for the rest of the run(and across --watch rebuilds).
+ */
+
+/* all the fragments parsed so far, one per path */
+list included_files = {NULL, NULL};
+
+/* parse a single line of an included file into fragment. returns SUCCESS on success, error code otherwise */
+int parse_included_line(include_fragment *fragment, char *line)
+{
+    char *label = NULL, *sep;
+    word *words, *tmp;
+    int res, guide_type;
+
+    /* check for label at the start of this line */
+    if((sep = strchr(line, ':')))
+    {
+        *sep = '\x0';
+        label = line;
+        line = skip_whitespaces(sep + 1);
+    }
+
+    switch((guide_type = read_guide_statement_type(line)))
+    {
+        case GUIDE_DATA:
+        case GUIDE_STRING:
+        case GUIDE_INCBIN:
+            if((res = read_guide_line(&words, line, NULL)) <= 0)
+                return res;
+
+            if(!(tmp = realloc(fragment->data, (fragment->size + res) * sizeof(word))))
+            {
+                free(words);
+                return ERR_MEM_ALLOC_FAILED;
+            }
+            fragment->data = tmp;
+            memcpy(fragment->data + fragment->size, words, res * sizeof(word));
+            free(words);
+
+            /* the words of a binary file can change while the text including them doesn't */
+            if(guide_type == GUIDE_INCBIN)
+                fragment->reusable = 0;
+
+            /* labels are kept at their offset, the fragment is moved as a whole */
+            if(label && (guide_type = add_symbol(&fragment->symbols, label, fragment->size, data)) != SUCCESS)
+                return guide_type;
+            fragment->size += res;
+            return SUCCESS;
+
+        case GUIDE_EXTERN:
+            res = read_guide_line(NULL, line, &fragment->symbols);
+            return res < 0 ? res : SUCCESS;
+
+        default:
+            return ERR_INVALID_INCLUDE;
+    }
+}
+
+/* parse the text of fragment, stopping at the first error */
+void parse_included_file(include_fragment *fragment)
+{
+    char *start, *end, *line = NULL, *tmp;
+    unsigned int len;
+
+    fragment->error = SUCCESS;
+    for(start = fragment->text; *start && fragment->error == SUCCESS; start = *end ? end + 1 : end)
+    {
+        /* the readers expect the newline read_line keeps */
+        for(end = start; *end && *end != '\n'; end++);
+        len = end - start;
+        if(!(tmp = realloc(line, len + 2)))
+        {
+            fragment->error = ERR_MEM_ALLOC_FAILED;
+            break;
+        }
+        line = tmp;
+        memcpy(line, start, len);
+        strcpy(line + len, "\n");
+
+        /* skip blank lines and comments */
+        if(*(tmp = skip_whitespaces(line)) && *tmp != ';')
+            fragment->error = parse_included_line(fragment, tmp);
+    }
+    free(line);
+}
+
+void free_included_file(include_fragment *fragment)
+{
+    free(fragment->path);
+    free(fragment->text);
+    free(fragment->data);
+    free_symbols_table(&fragment->symbols);
+    free(fragment);
+}
+
+/* find the fragment of file_path, parsing it again only if its contents changed. returns NULL on failure */
+include_fragment *get_included_file(char *file_path, int *error)
+{
+    include_fragment *fragment = NULL;
+    node *curr;
+    char *text;
+    unsigned long hash;
+
+    if(!(text = read_text_file(file_path)))
+    {
+        *error = ERR_COULD_NOT_OPEN_FILE;
+        return NULL;
+    }
+    hash = hash_string(text);
+
+    for(curr = included_files.head; curr && strcmp(((include_fragment *)curr->data)->path, file_path); curr = curr->next);
+    if(curr)
+    {
+        fragment = (include_fragment *)curr->data;
+        if(fragment->reusable && fragment->hash == hash && !strcmp(fragment->text, text))
+        {
+            free(text);
+            return fragment;
+        }
+
+        /* parse the new contents in place of the old ones */
+        free(fragment->text);
+        free(fragment->data);
+        free_symbols_table(&fragment->symbols);
+    }
+    else if(!(fragment = calloc(1, sizeof(include_fragment))) || !(fragment->path = malloc(strlen(file_path) + 1)) ||
+            insert(&included_files, fragment) != SUCCESS)
+    {
+        if(fragment)
+            free(fragment->path);
+        free(fragment);
+        free(text);
+        *error = ERR_MEM_ALLOC_FAILED;
+        return NULL;
+    }
+    else
+    {
+        strcpy(fragment->path, file_path);
+    }
+
+    fragment->text = text;
+    fragment->hash = hash;
+    fragment->reusable = 1;
+    fragment->data = NULL;
+    fragment->size = 0;
+    init_symbol_table(&fragment->symbols);
+    parse_included_file(fragment);
+    return fragment;
+}
+
+/* copy the words of an included file into dst(unless NULL) and its symbols into symbols(unless NULL).
+ * the labels are added relative to the start of the data segment, the caller moves them along with the words.
+ * returns the number of words on success, error code otherwise. */
+int splice_included_file(word **dst, char *file_path, symbol_table *symbols)
+{
+    include_fragment *fragment;
+    symbol_entry *symbol;
+    node *curr;
+    int res;
+
+    if(!(fragment = get_included_file(file_path, &res)))
+        return res;
+    if(fragment->error != SUCCESS)
+        return fragment->error;
+
+    if(dst && fragment->size)
+    {
+        if(!(*dst = malloc(fragment->size * sizeof(word))))
+            return ERR_MEM_ALLOC_FAILED;
+        memcpy(*dst, fragment->data, fragment->size * sizeof(word));
+    }
+
+    for(curr = symbols ? fragment->symbols.symbols.head : NULL; curr; curr = curr->next)
+    {
+        symbol = (symbol_entry *)curr->data;
+        if((res = add_symbol(symbols, symbol->name, symbols->base_address[symbol->type] + symbol->offset, symbol->type)) != SUCCESS)
+        {
+            if(dst && fragment->size)
+                free(*dst);
+            return res;
+        }
+    }
+    return fragment->size;
+}
+
+/* free all the fragments kept for the run */
+void free_included_files(void)
+{
+    node *curr, *next;
+    for(curr = included_files.head; curr; curr = next)
+    {
+        next = curr->next;
+        free_included_file((include_fragment *)curr->data);
+        free(curr);
+    }
+    init_list(&included_files);
+}
@@ -0,0 +1,22 @@
+#ifndef _INCLUDE_H
+#define _INCLUDE_H
+
+#include "memory_map.h"
+#include "symbols_table.h"
+
+/* an included file, parsed once and spliced into every file including it */
+typedef struct {
+    char *path;
+    char *text; /* the contents it was parsed from */
+    unsigned long hash; /* of text */
+    int error; /* SUCCESS, or the error parsing it failed with */
+    unsigned int reusable:1; /* not if it depends on more than its own text(.incbin) */
+    word *data;
+    unsigned int size;
+    symbol_table symbols; /* the externals, and the labels at their offset from the first word */
+} include_fragment;
+
+int splice_included_file(word **dst, char *file_path, symbol_table *symbols);
+void free_included_files(void);
+
+#endif
@@ -0,0 +1,564 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "incremental.h"
+#include "first_pass.h"
+#include "second_pass.h"
+#include "instructions_table.h"
+#include "memory_map.h"
+#include "symbols_table.h"
+#include "externals.h"
+#include "utilities.h"
+#include "errors.h"
+#include "options.h"
+#include "alloc_tracking.h"
+
+#define STATE_FILE_MAGIC 0x32435341UL /* "ASC2" */
+#define STATE_FILE_HEADER_SIZE 8 /* magic and checksum of the rest of the file */
+#define MIN_LINE_RECORD_SIZE 5 /* length of an empty text and a kind */
+#define MIN_SYMBOL_RECORD_SIZE 9 /* length of an empty name, value and type */
+#define INITIAL_NUMBER_OF_LINES 256
+
+/* check if line should be skipped by both passes(blank line or comment) */
+#define IS_BLANK_LINE(line) (!*(line) || *(line) == ';')
+
+/* read a string written by write_string into a label buffer. returns SUCCESS on success, error code otherwise. */
+int read_label(FILE *fh, char *dst)
+{
+    char *s = read_string(fh, MAX_LABEL_LEN);
+    if(!s)
+        return ERR_INVALID_VALUE;
+    strcpy(dst, s);
+    free(s);
+    return SUCCESS;
+}
+
+void free_file_state(file_state *state)
+{
+    unsigned int i;
+    for(i = 0; i < state->number_of_lines; i++)
+    {
+        free(state->lines[i].text);
+
+        /* words and references of the current run are owned by the memory items */
+        if(!state->lines[i].item)
+        {
+            free(state->lines[i].data);
+            free(state->lines[i].references);
+        }
+    }
+    free(state->lines);
+    free(state->symbols);
+    free(state->line_buckets);
+    free(state->symbol_buckets);
+    memset(state, 0, sizeof(file_state));
+}
+
+/* add a new line to the state, the text is taken as is. returns the new line or NULL on failure */
+line_state *add_line(file_state *state, char *text, unsigned int *capacity)
+{
+    line_state *tmp, *line;
+
+    /* make room for one more line */
+    if(state->number_of_lines == *capacity)
+    {
+        if(!(tmp = realloc(state->lines, (*capacity ? *capacity * 2 : INITIAL_NUMBER_OF_LINES) * sizeof(line_state))))
+            return NULL;
+        *capacity = *capacity ? *capacity * 2 : INITIAL_NUMBER_OF_LINES;
+        state->lines = tmp;
+    }
+
+    line = state->lines + state->number_of_lines++;
+    memset(line, 0, sizeof(line_state));
+    line->text = text;
+    line->hash = hash_string(text);
+    line->reused_line = -1;
+    return line;
+}
+
+/* read a single line record of the state file. returns SUCCESS on success, error code otherwise. */
+int load_line(FILE *fh, line_state *line)
+{
+    unsigned int i;
+    symbol_reference *reference;
+
+    if((line->kind = getc(fh)) == LINE_OTHER)
+        return SUCCESS;
+    if(line->kind != LINE_CODE && line->kind != LINE_DATA)
+        return ERR_INVALID_VALUE;
+
+    /* an instruction has an operand word at most per operand, a data item never has more words than chars */
+    line->address = read_u32(fh);
+    line->size_in_words = read_u32(fh);
+    if(feof(fh) || !line->size_in_words ||
+       line->size_in_words > (line->kind == LINE_CODE ? 1 + MAX_OPERANDS : strlen(line->text)) ||
+       !(line->data = malloc(line->size_in_words * sizeof(word))))
+        return ERR_INVALID_VALUE;
+    for(i = 0; i < line->size_in_words; i++)
+        line->data[i].val = read_u32(fh);
+
+    if(read_label(fh, line->label) != SUCCESS)
+        return ERR_INVALID_VALUE;
+
+    line->number_of_references = getc(fh);
+    if(line->number_of_references > MAX_REFERENCES)
+        return ERR_INVALID_VALUE;
+    if(line->number_of_references && !(line->references = malloc(line->number_of_references * sizeof(symbol_reference))))
+        return ERR_MEM_ALLOC_FAILED;
+    for(i = 0; i < line->number_of_references; i++)
+    {
+        reference = line->references + i;
+        reference->word_offset = getc(fh);
+        reference->addressing_method = getc(fh);
+        if(reference->word_offset >= line->size_in_words || read_label(fh, reference->symbol_name) != SUCCESS)
+            return ERR_INVALID_VALUE;
+    }
+    return feof(fh) ? ERR_INVALID_VALUE : SUCCESS;
+}
+
+/* hash index the lines that could be reused and the symbols. returns SUCCESS on success, error code otherwise. */
+int index_file_state(file_state *state)
+{
+    unsigned int i, bucket;
+
+    for(state->number_of_buckets = 16;
+        state->number_of_buckets < state->number_of_lines || state->number_of_buckets < state->number_of_symbols;
+        state->number_of_buckets *= 2);
+
+    state->line_buckets = malloc(state->number_of_buckets * sizeof(int));
+    state->symbol_buckets = malloc(state->number_of_buckets * sizeof(int));
+    if(!state->line_buckets || !state->symbol_buckets)
+        return ERR_MEM_ALLOC_FAILED;
+
+    for(i = 0; i < state->number_of_buckets; i++)
+        state->line_buckets[i] = state->symbol_buckets[i] = -1;
+
+    /* insert in reverse order so each chain is sorted by line number */
+    for(i = state->number_of_lines; i-- > 0;)
+    {
+        if(state->lines[i].kind != LINE_OTHER)
+        {
+            bucket = state->lines[i].hash & (state->number_of_buckets - 1);
+            state->lines[i].next = state->line_buckets[bucket];
+            state->line_buckets[bucket] = i;
+        }
+    }
+    for(i = state->number_of_symbols; i-- > 0;)
+    {
+        bucket = hash_string(state->symbols[i].name) & (state->number_of_buckets - 1);
+        state->symbols[i].next = state->symbol_buckets[bucket];
+        state->symbol_buckets[bucket] = i;
+    }
+    return SUCCESS;
+}
+
+/* load the state saved by the previous run, with no line longer than max_line_len(a longer one can't be reused).
+ * returns SUCCESS on success, error code otherwise. */
+int load_file_state(file_state *state, char *file_path, unsigned long max_line_len)
+{
+    char name[MAX_FILE_PATH];
+    FILE *fh;
+    int res = ERR_INVALID_VALUE;
+    unsigned int i, number_of_lines, capacity = 0;
+    unsigned long checksum;
+    long file_size;
+    char *text;
+
+    sprintf(name, "%s.cache", file_path);
+    if(!(fh = fopen(name, "rb")))
+        return ERR_COULD_NOT_OPEN_FILE;
+
+    /* a damaged file is never trusted, and the counts can't promise more records than it has room for */
+    if(read_u32(fh) == STATE_FILE_MAGIC)
+    {
+        checksum = read_u32(fh);
+        if(hash_stream(fh) == checksum && (file_size = ftell(fh)) >= 0 && fseek(fh, STATE_FILE_HEADER_SIZE, SEEK_SET) == 0 &&
+           (number_of_lines = read_u32(fh)) <= file_size / MIN_LINE_RECORD_SIZE)
+        {
+            for(res = SUCCESS, i = 0; i < number_of_lines && res == SUCCESS; i++)
+            {
+                if(!(text = read_string(fh, max_line_len)))
+                    res = ERR_INVALID_VALUE;
+                else if(!add_line(state, text, &capacity))
+                    res = ERR_MEM_ALLOC_FAILED;
+                else
+                    res = load_line(fh, state->lines + i);
+            }
+
+            state->number_of_symbols = read_u32(fh);
+            if(res == SUCCESS && !feof(fh) && state->number_of_symbols <= file_size / MIN_SYMBOL_RECORD_SIZE &&
+               (state->symbols = calloc(state->number_of_symbols + 1, sizeof(symbol_state))))
+            {
+                for(i = 0; i < state->number_of_symbols && res == SUCCESS; i++)
+                {
+                    res = read_label(fh, state->symbols[i].name);
+                    state->symbols[i].val = read_u32(fh);
+                    state->symbols[i].type = getc(fh);
+                }
+
+                /* the records end right at the end of the file */
+                if(res == SUCCESS && !feof(fh) && getc(fh) == EOF)
+                    res = index_file_state(state);
+                else
+                    res = ERR_INVALID_VALUE;
+            }
+            else
+            {
+                state->number_of_symbols = 0;
+                res = ERR_INVALID_VALUE;
+            }
+        }
+    }
+    fclose(fh);
+
+    /* never use half loaded state */
+    if(res != SUCCESS)
+        free_file_state(state);
+    return res;
+}
+
+/* find a line of the previous run with the same text, trying the preferred line first. returns line index or -1 if not found */
+int find_previous_line(file_state *previous, line_state *line, int preferred)
+{
+    int i;
+
+    if(!previous->number_of_buckets)
+        return -1;
+
+    /* after an edit, lines usually keep their distance from the previous run lines */
+    if(preferred >= 0 && preferred < previous->number_of_lines && previous->lines[preferred].kind != LINE_OTHER &&
+       previous->lines[preferred].hash == line->hash && !strcmp(previous->lines[preferred].text, line->text))
+        return preferred;
+
+    for(i = previous->line_buckets[line->hash & (previous->number_of_buckets - 1)]; i >= 0; i = previous->lines[i].next)
+    {
+        if(previous->lines[i].hash == line->hash && !strcmp(previous->lines[i].text, line->text))
+            return i;
+    }
+    return -1;
+}
+
+/* find a symbol of the previous run by name. returns NULL if not found */
+symbol_state *find_previous_symbol(file_state *previous, char *name)
+{
+    int i;
+
+    if(!previous->number_of_buckets)
+        return NULL;
+
+    for(i = previous->symbol_buckets[hash_string(name) & (previous->number_of_buckets - 1)]; i >= 0; i = previous->symbols[i].next)
+    {
+        if(!strcmp(previous->symbols[i].name, name))
+            return previous->symbols + i;
+    }
+    return NULL;
+}
+
+/* add the words, references and label the previous run encoded for the same line text */
+int reuse_line(line_state *line, line_state *previous_line, unsigned int line_number, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols)
+{
+    int res, tmp;
+    memory_segment *segment = previous_line->kind == LINE_CODE ? code_segment : data_segment;
+    word *words = malloc(previous_line->size_in_words * sizeof(word));
+
+    if(!words)
+        return ERR_MEM_ALLOC_FAILED;
+    memcpy(words, previous_line->data, previous_line->size_in_words * sizeof(word));
+
+    if((res = add_memory_item(segment, previous_line->size_in_words, words, line_number)) < 0)
+    {
+        free(words);
+        return res;
+    }
+
+    line->kind = previous_line->kind;
+    line->item = get_tail(&segment->items);
+    strcpy(line->label, previous_line->label);
+    if((tmp = set_memory_item_references(line->item, previous_line->references, previous_line->number_of_references)) != SUCCESS)
+        return tmp;
+
+    /* save the label(if any) in the symbols table for later */
+    if(*line->label)
+    {
+        if((tmp = add_symbol(symbols, line->label, res, line->kind == LINE_CODE ? code : data)) == SUCCESS)
+            ((symbol_entry *)get_tail(&symbols->symbols))->line_number = line_number;
+        else
+            res = tmp;
+    }
+    return res;
+}
+
+/* encode a line from scratch and remember what it produced */
+int encode_line(line_state *line, char *text, unsigned int line_number, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols)
+{
+    int res, guide_type;
+    node *code_tail = code_segment->items.tail, *data_tail = data_segment->items.tail;
+    char *buf, *sep, *statement = text;
+
+    /* the first pass splits the line in place, work on a copy */
+    if(!(buf = malloc(strlen(text) + 1)))
+        return ERR_MEM_ALLOC_FAILED;
+    res = process_line(strcpy(buf, text), line_number, code_segment, data_segment, symbols);
+    free(buf);
+
+    if((sep = strchr(text, ':')))
+        statement = skip_whitespaces(sep + 1);
+    guide_type = read_guide_statement_type(statement);
+
+    /* only instructions, .data and .string depend on nothing but the line text */
+    if(code_segment->items.tail != code_tail)
+    {
+        line->kind = LINE_CODE;
+        line->item = get_tail(&code_segment->items);
+    }
+    else if(data_segment->items.tail != data_tail && (guide_type == GUIDE_DATA || guide_type == GUIDE_STRING))
+    {
+        line->kind = LINE_DATA;
+        line->item = get_tail(&data_segment->items);
+    }
+
+    if(line->kind != LINE_OTHER && sep)
+        sprintf(line->label, "%.*s", (int)(sep - text) < MAX_LABEL_LEN ? (int)(sep - text) : MAX_LABEL_LEN, text);
+    return res;
+}
+
+/* first pass reusing the encoding of lines which did not change since the previous run. returns number of error(lines) found in the file. */
+int incremental_first_pass(incremental_state *state, char *file_path, FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols)
+{
+    char *buf = NULL, *text, *line;
+    unsigned int buf_size = 0, capacity = 0, i;
+    int res, previous_line, offset = 0;
+    int number_of_errors = 0;
+    line_state *curr;
+
+    memset(state, 0, sizeof(incremental_state));
+
+    /* keep the whole file, we need it for the second pass and for the next run */
+    while(read_line(fh, &buf, &buf_size))
+    {
+        if(!(text = malloc(strlen(buf) + 1)) || !add_line(&state->current, strcpy(text, buf), &capacity))
+        {
+            free(text);
+            free(buf);
+            printf("ERROR! %s\n", error_code_to_string(ERR_MEM_ALLOC_FAILED));
+            return number_of_errors + 1;
+        }
+    }
+    free(buf);
+
+    /* start from scratch if there's no usable state, a line that doesn't fit the line buffer never matches one of ours */
+    res = load_file_state(&state->previous, file_path, buf_size ? buf_size - 1 : 0);
+    if(res != SUCCESS && res != ERR_COULD_NOT_OPEN_FILE)
+        printf(">> Ignoring the invalid state in \"%s.cache\", assembling from scratch\n", file_path);
+
+    for(i = 0; i < state->current.number_of_lines; i++)
+    {
+        curr = state->current.lines + i;
+
+        /* skip blank lines and comments */
+        if(IS_BLANK_LINE(line = skip_whitespaces(curr->text)))
+            continue;
+
+        if((previous_line = find_previous_line(&state->previous, curr, i + offset)) >= 0)
+        {
+            res = reuse_line(curr, state->previous.lines + previous_line, i + 1, code_segment, data_segment, symbols);
+            curr->reused_line = previous_line;
+            offset = previous_line - (int)i;
+            state->number_of_reused_lines++;
+        }
+        else
+        {
+            res = encode_line(curr, line, i + 1, code_segment, data_segment, symbols);
+        }
+
+        if(res < 0) /* check for errors */
+        {
+            printf("ERROR! %s [line %d]\r\n", error_code_to_string(res), i + 1);
+            number_of_errors++;
+        }
+    }
+    return number_of_errors;
+}
+
+/* check if a reused instruction must be resolved again: it uses a symbol which moved, or it moved and uses relative addressing */
+int requires_resolving(incremental_state *state, line_state *previous_line, unsigned int address)
+{
+    unsigned int i;
+    symbol_state *symbol;
+
+    for(i = 0; i < previous_line->number_of_references; i++)
+    {
+        symbol = find_previous_symbol(&state->previous, previous_line->references[i].symbol_name);
+        if(!symbol || !symbol->unchanged)
+            return 1;
+        if(previous_line->references[i].addressing_method == ADDR_RELATIVE && address != previous_line->address)
+            return 1;
+    }
+    return 0;
+}
+
+/* find the symbols which kept their address and type since the previous run */
+void mark_unchanged_symbols(incremental_state *state, symbol_table *symbols)
+{
+    node *curr;
+    symbol_entry *symbol;
+    symbol_state *previous_symbol;
+    unsigned int i;
+
+    for(i = 0; i < state->previous.number_of_symbols; i++)
+        state->previous.symbols[i].unchanged = state->previous.symbols[i].seen = 0;
+
+    /* only the first symbol with a given name is ever resolved */
+    for(curr = symbols->symbols.head; curr; curr = curr->next)
+    {
+        symbol = (symbol_entry *)curr->data;
+        if((previous_symbol = find_previous_symbol(&state->previous, symbol->name)) && !previous_symbol->seen)
+        {
+            previous_symbol->seen = 1;
+            previous_symbol->unchanged = previous_symbol->val == symbol_address(symbols, symbol) && previous_symbol->type == symbol->type;
+        }
+    }
+}
+
+/* complete the encoding of a single instruction line */
+int complete_line(incremental_state *state, line_state *line, memory_segment *code_segment, symbol_table *symbols, externals_table *external_symbols)
+{
+    unsigned int i, address = calc_absolute_address(code_segment, line->item);
+    symbol_reference *reference;
+
+    /* the cross reference index is built from the symbols resolved, so resolve everything when asked for it */
+    if(line->reused_line < 0 || options.xref || requires_resolving(state, state->previous.lines + line->reused_line, address))
+        return complete_instruction_encoding(code_segment, line->item, symbols, external_symbols);
+
+    /* the words we copied are already final, only externals have to be listed again */
+    for(i = 0; i < line->item->number_of_references; i++)
+    {
+        reference = line->item->references + i;
+        if(line->item->data[reference->word_offset].val & ARE_E)
+            add_external_item(external_symbols, reference->symbol_name, address + reference->word_offset);
+    }
+    return SUCCESS;
+}
+
+/* second pass resolving only the symbols that might have changed since the previous run. returns number of error(lines) found in the file. */
+int incremental_second_pass(incremental_state *state, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, externals_table *external_symbols)
+{
+    unsigned int i;
+    int res;
+    int number_of_errors = 0;
+    char *buf, *line;
+    line_state *curr;
+
+    mark_unchanged_symbols(state, symbols);
+
+    for(i = 0; i < state->current.number_of_lines; i++)
+    {
+        curr = state->current.lines + i;
+
+        /* skip blank lines and comments */
+        if(IS_BLANK_LINE(line = skip_whitespaces(curr->text)))
+            continue;
+
+        switch(curr->kind)
+        {
+            case LINE_CODE:
+                res = complete_line(state, curr, code_segment, symbols, external_symbols);
+                break;
+
+            case LINE_DATA:
+                res = SUCCESS; /* nothing to complete */
+                break;
+
+            default:
+                /* the second pass splits the line in place, work on a copy */
+                if((buf = malloc(strlen(line) + 1)))
+                {
+                    res = second_pass_process_line(strcpy(buf, line), i + 1, code_segment, data_segment, symbols, external_symbols);
+                    free(buf);
+                }
+                else
+                {
+                    res = ERR_MEM_ALLOC_FAILED;
+                }
+                break;
+        }
+
+        if(res < 0) /* check for errors */
+        {
+            printf("ERROR! %s [line %d]\r\n", error_code_to_string(res), i + 1);
+            number_of_errors++;
+        }
+    }
+    return number_of_errors;
+}
+
+/* save the state of the current run for the next one. returns SUCCESS on success, error code otherwise. */
+int save_incremental_state(incremental_state *state, char *file_path, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols)
+{
+    char name[MAX_FILE_PATH];
+    FILE *fh;
+    unsigned int i, j, number_of_symbols = 0;
+    unsigned long checksum;
+    line_state *line;
+    memory_item *item;
+    node *curr;
+
+    sprintf(name, "%s.cache", file_path);
+    if(!(fh = fopen(name, "w+b")))
+        return ERR_COULD_NOT_OPEN_FILE;
+
+    /* the checksum is filled once the rest is written */
+    write_u32(fh, STATE_FILE_MAGIC);
+    write_u32(fh, 0);
+    write_u32(fh, state->current.number_of_lines);
+    for(i = 0; i < state->current.number_of_lines; i++)
+    {
+        line = state->current.lines + i;
+        write_string(fh, line->text);
+        putc(line->kind, fh);
+        if(line->kind == LINE_OTHER)
+            continue;
+
+        item = line->item;
+        write_u32(fh, calc_absolute_address(line->kind == LINE_CODE ? code_segment : data_segment, item));
+        write_u32(fh, item->size_in_words);
+        for(j = 0; j < item->size_in_words; j++)
+            write_u32(fh, item->data[j].val);
+        write_string(fh, line->label);
+
+        putc(item->number_of_references, fh);
+        for(j = 0; j < item->number_of_references; j++)
+        {
+            putc(item->references[j].word_offset, fh);
+            putc(item->references[j].addressing_method, fh);
+            write_string(fh, item->references[j].symbol_name);
+        }
+    }
+
+    for(curr = symbols->symbols.head; curr; curr = curr->next)
+        number_of_symbols++;
+    write_u32(fh, number_of_symbols);
+    for(curr = symbols->symbols.head; curr; curr = curr->next)
+    {
+        write_string(fh, ((symbol_entry *)curr->data)->name);
+        write_u32(fh, symbol_address(symbols, (symbol_entry *)curr->data));
+        putc(((symbol_entry *)curr->data)->type, fh);
+    }
+
+    if(fflush(fh) || fseek(fh, STATE_FILE_HEADER_SIZE, SEEK_SET))
+    {
+        fclose(fh);
+        return ERR_COULD_NOT_OPEN_FILE;
+    }
+    checksum = hash_stream(fh);
+    if(fseek(fh, STATE_FILE_HEADER_SIZE - 4, SEEK_SET) == 0)
+        write_u32(fh, checksum);
+    return (ferror(fh) | fclose(fh)) ? ERR_COULD_NOT_OPEN_FILE : SUCCESS;
+}
+
+void free_incremental_state(incremental_state *state)
+{
+    free_file_state(&state->previous);
+    free_file_state(&state->current);
+}
@@ -0,0 +1,61 @@
+#ifndef _INCREMENTAL_H
+#define _INCREMENTAL_H
+
+#include <stdio.h>
+
+#include "memory_map.h"
+#include "symbols_table.h"
+#include "externals.h"
+
+/* kinds of source lines kept in the state file */
+#define LINE_OTHER 0 /* blank lines, comments and statements which are always processed again */
+#define LINE_CODE 1
+#define LINE_DATA 2
+
+typedef struct {
+    char *text; /* the line as read from the source file */
+    unsigned long hash;
+    unsigned char kind;
+    unsigned int address; /* final absolute address of the line's words */
+    unsigned int size_in_words;
+    word *data; /* final encoded words */
+    unsigned int number_of_references;
+    symbol_reference *references;
+    char label[MAX_LABEL_LEN + 1];
+    memory_item *item; /* item of the current run, NULL for lines loaded from the state file */
+    int reused_line; /* index of the line of the previous run with the same text, -1 if encoded from scratch */
+    int next; /* next line in the same hash bucket, -1 terminated */
+} line_state;
+
+typedef struct {
+    char name[MAX_LABEL_LEN + 1];
+    unsigned int val;
+    unsigned char type;
+    unsigned int unchanged:1; /* same address and type in the current run */
+    unsigned int seen:1;
+    int next; /* next symbol in the same hash bucket, -1 terminated */
+} symbol_state;
+
+/* everything kept between runs for a single source file */
+typedef struct {
+    unsigned int number_of_lines;
+    line_state *lines;
+    unsigned int number_of_symbols;
+    symbol_state *symbols;
+    unsigned int number_of_buckets; /* power of 2, used for both lines and symbols */
+    int *line_buckets;
+    int *symbol_buckets;
+} file_state;
+
+typedef struct {
+    file_state previous; /* as loaded from the state file */
+    file_state current;
+    unsigned int number_of_reused_lines;
+} incremental_state;
+
+int incremental_first_pass(incremental_state *state, char *file_path, FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols);
+int incremental_second_pass(incremental_state *state, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, externals_table *external_symbols);
+int save_incremental_state(incremental_state *state, char *file_path, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols);
+void free_incremental_state(incremental_state *state);
+
+#endif
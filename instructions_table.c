@@ -5,42 +5,51 @@
 
 #include "utilities.h"
 #include "memory_map.h"
+#include "instructions_table.h"
 #include "errors.h"
 
 #define INSTRUCTION_TABLE_SIZE (sizeof(instruction_table) / sizeof(instruction_descriptor))
 
-typedef struct {
-    unsigned int immediate:1;
-    unsigned int direct:1;
-    unsigned int relative:1;
-    unsigned int register_direct:1;
-} supported_addressing_methods;
+/* addressing methods masks, bit n is set when addressing method n is supported */
+#define NONE 0
+#define IMM (1 << ADDR_IMMEDIATE)
+#define DIR (1 << ADDR_DIRECT)
+#define REL (1 << ADDR_RELATIVE)
+#define REG (1 << ADDR_REG_DIRECT)
+
+/* build a descriptor with the instruction word template(opcode, funct & A flag) already in place */
+#define DESCRIPTOR(name, opcode, funct, src_methods, dst_methods) \
+    {name, \
+     ((unsigned long)(opcode) << OPCODE_SHIFT) | ((unsigned long)(funct) << FUNCT_SHIFT) | ARE_A, \
+     ((src_methods) != NONE) + ((dst_methods) != NONE), \
+     src_methods, \
+     dst_methods}
 
 typedef struct {
     const char *name;
-    unsigned short opcode;
-    unsigned short funct;
-    supported_addressing_methods src_op_addressing;
-    supported_addressing_methods dst_op_addressing;
+    unsigned long base_word;
+    unsigned char number_of_operands;
+    unsigned char src_methods;
+    unsigned char dst_methods;
 } instruction_descriptor;
 
 /* all instructions are defined here with the opcode, func and supported addressing methods */
-instruction_descriptor instruction_table[] = {{"mov", 0, 0, {1, 1, 0, 1}, {0, 1, 0, 1}},
-                                              {"cmp", 1, 0, {1, 1, 0, 1}, {1, 1, 0, 1}},
-                                              {"add", 2, 1, {1, 1, 0, 1}, {0, 1, 0, 1}},
-                                              {"sub", 2, 2, {1, 1, 0, 1}, {0, 1, 0, 1}},
-                                              {"lea", 4, 0, {0, 1, 0, 0}, {0, 1, 0, 1}},
-                                              {"clr", 5, 1, {0, 0, 0, 0}, {0, 1, 0, 1}},
-                                              {"not", 5, 2, {0, 0, 0, 0}, {0, 1, 0, 1}},
-                                              {"inc", 5, 3, {0, 0, 0, 0}, {0, 1, 0, 1}},
-                                              {"dec", 5, 4, {0, 0, 0, 0}, {0, 1, 0, 1}},
-                                              {"jmp", 9, 1, {0, 0, 0, 0}, {0, 1, 1, 0}},
-                                              {"bne", 9, 2, {0, 0, 0, 0}, {0, 1, 1, 0}},
-                                              {"jsr", 9, 3, {0, 0, 0, 0}, {0, 1, 1, 0}},
-                                              {"red", 12, 0, {0, 0, 0, 0}, {0, 1, 0, 1}},
-                                              {"prn", 13, 0, {0, 0, 0, 0}, {1, 1, 0, 1}},
-                                              {"rts", 14, 0, {0, 0, 0, 0}, {0, 0, 0, 0}},
-                                              {"stop", 15, 0, {0, 0, 0, 0}, {0, 0, 0, 0}}};
+static const instruction_descriptor instruction_table[] = {DESCRIPTOR("mov", 0, 0, IMM | DIR | REG, DIR | REG),
+                                                           DESCRIPTOR("cmp", 1, 0, IMM | DIR | REG, IMM | DIR | REG),
+                                                           DESCRIPTOR("add", 2, 1, IMM | DIR | REG, DIR | REG),
+                                                           DESCRIPTOR("sub", 2, 2, IMM | DIR | REG, DIR | REG),
+                                                           DESCRIPTOR("lea", 4, 0, DIR, DIR | REG),
+                                                           DESCRIPTOR("clr", 5, 1, NONE, DIR | REG),
+                                                           DESCRIPTOR("not", 5, 2, NONE, DIR | REG),
+                                                           DESCRIPTOR("inc", 5, 3, NONE, DIR | REG),
+                                                           DESCRIPTOR("dec", 5, 4, NONE, DIR | REG),
+                                                           DESCRIPTOR("jmp", 9, 1, NONE, DIR | REL),
+                                                           DESCRIPTOR("bne", 9, 2, NONE, DIR | REL),
+                                                           DESCRIPTOR("jsr", 9, 3, NONE, DIR | REL),
+                                                           DESCRIPTOR("red", 12, 0, NONE, DIR | REG),
+                                                           DESCRIPTOR("prn", 13, 0, NONE, IMM | DIR | REG),
+                                                           DESCRIPTOR("rts", 14, 0, NONE, NONE),
+                                                           DESCRIPTOR("stop", 15, 0, NONE, NONE)};
 
 /* get instruction number in the table by its name */
 int get_instruction_id(char *name)
@@ -54,70 +63,63 @@ int get_instruction_id(char *name)
     return ERR_INSTRUCTION_NOT_FOUND;
 }
 
+/* get instruction number in the table by its encoded instruction word */
+int decode_instruction_id(unsigned long val)
+{
+    int i;
+    for (i = 0; i < INSTRUCTION_TABLE_SIZE; i++)
+    {
+        if(OPCODE(val) == OPCODE(instruction_table[i].base_word) && FUNCT(val) == FUNCT(instruction_table[i].base_word))
+            return i;
+    }
+    return ERR_INSTRUCTION_NOT_FOUND;
+}
+
+/* returns number of instructions in the table, their numbers are 0 to it */
+int get_number_of_instructions(void)
+{
+    return INSTRUCTION_TABLE_SIZE;
+}
+
+/* get instruction name by the instruction number in the table */
+const char *get_instruction_name(unsigned short instruction_id)
+{
+    return instruction_table[instruction_id].name;
+}
+
 /* get instruction opcode by the instruction number in the table */
 unsigned short get_opcode(unsigned short instruction_id)
 {
-    return instruction_table[instruction_id].opcode;
+    return WORD_FIELD(instruction_table[instruction_id].base_word, OPCODE_SHIFT, 6);
 }
 
 /* get instruction funct by the instruction number in the table */
 unsigned short get_funct(unsigned short instruction_id)
 {
-    return instruction_table[instruction_id].funct;
+    return WORD_FIELD(instruction_table[instruction_id].base_word, FUNCT_SHIFT, 5);
 }
 
 /* returns the number of operands given instruction takes */
 int get_number_of_operands(unsigned short instruction_id)
 {
-    int n = 0;
-    if (*((unsigned int *)&instruction_table[instruction_id].src_op_addressing))
-        n++;
-    if (*((unsigned int *)&instruction_table[instruction_id].dst_op_addressing))
-        n++;
-    return n;
-}
-
-/* check if addressing method is in the supported methods */
-int is_addressing_method_supported(supported_addressing_methods supported_methods, int method)
-{
-    switch (method)
-    {
-        case ADDR_IMMEDIATE:
-            return supported_methods.immediate;
-        case ADDR_DIRECT:
-            return supported_methods.direct;
-        case ADDR_RELATIVE:
-            return supported_methods.relative;
-        case ADDR_REG_DIRECT:
-            return supported_methods.register_direct;
-        default:
-            return 0;
-    }
+    return instruction_table[instruction_id].number_of_operands;
 }
 
 /* check if addressing method is in the supported methods of the source operands */
-int is_source_addressing_method_supported(int instruction_id, int method)
+int is_source_addressing_method_supported(unsigned short instruction_id, int method)
 {
-    return is_addressing_method_supported(instruction_table[instruction_id].src_op_addressing, method);
+    return (instruction_table[instruction_id].src_methods >> method) & 1;
 }
 
 /* check if addressing method is in the supported methods of the destination operands */
-int is_dest_addressing_method_supported(int instruction_id, int method)
+int is_dest_addressing_method_supported(unsigned short instruction_id, int method)
 {
-    return is_addressing_method_supported(instruction_table[instruction_id].dst_op_addressing, method);
+    return (instruction_table[instruction_id].dst_methods >> method) & 1;
 }
 
-/* initialize instruction struct by it's id */
-instruction* init_instruction(instruction *dst, int instruction_id)
+/* initialize instruction word by it's id */
+word *init_instruction(word *dst, int instruction_id)
 {
-    dst->opcode = get_opcode(instruction_id);
-    dst->funct = get_funct(instruction_id);
-    dst->source_addressing_method = 0;
-    dst->source_register = 0;
-    dst->dest_addressing_method = 0;
-    dst->dest_register = 0;
-    dst->A = 1;
-    dst->R = 0;
-    dst->E = 0;
+    dst->val = instruction_table[instruction_id].base_word;
     return dst;
 }
@@ -3,12 +3,18 @@
 
 #include "memory_map.h"
 
+/* maximum number of operands of an instruction */
+#define MAX_OPERANDS 2
+
+int get_number_of_instructions(void);
+const char *get_instruction_name(unsigned short instruction_id);
 int get_number_of_operands(unsigned short instruction_id);
 int is_source_addressing_method_supported(unsigned short instruction_id, int method);
 int is_dest_addressing_method_supported(unsigned short instruction_id, int method);
 unsigned short get_opcode(unsigned short instruction_id);
 unsigned short get_funct(unsigned short instruction_id);
 int get_instruction_id(char *name);
-instruction* init_instruction(instruction *dst, int instruction_id);
+int decode_instruction_id(unsigned long val);
+word *init_instruction(word *dst, int instruction_id);
 
 #endif
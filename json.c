@@ -0,0 +1,321 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "json.h"
+#include "alloc_tracking.h"
+
+/* maximum nesting of arrays and objects we agree to parse */
+#define JSON_MAX_DEPTH 64
+
+json_value *parse_json_value(char **s, unsigned int depth);
+
+/* skip whitespaces between tokens */
+char *skip_json_whitespaces(char *s)
+{
+    while(*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')
+        s++;
+    return s;
+}
+
+/* write code point as utf-8 into dst. returns number of bytes written */
+unsigned int write_utf8(char *dst, unsigned long code_point)
+{
+    if(code_point < 0x80)
+    {
+        dst[0] = code_point;
+        return 1;
+    }
+    if(code_point < 0x800)
+    {
+        dst[0] = 0xc0 | (code_point >> 6);
+        dst[1] = 0x80 | (code_point & 0x3f);
+        return 2;
+    }
+    if(code_point < 0x10000)
+    {
+        dst[0] = 0xe0 | (code_point >> 12);
+        dst[1] = 0x80 | ((code_point >> 6) & 0x3f);
+        dst[2] = 0x80 | (code_point & 0x3f);
+        return 3;
+    }
+    dst[0] = 0xf0 | (code_point >> 18);
+    dst[1] = 0x80 | ((code_point >> 12) & 0x3f);
+    dst[2] = 0x80 | ((code_point >> 6) & 0x3f);
+    dst[3] = 0x80 | (code_point & 0x3f);
+    return 4;
+}
+
+/* read 4 hex digits of a \u escape. returns the value, or -1 if invalid */
+long read_json_hex(char *s)
+{
+    long val = 0;
+    int i;
+    for(i = 0; i < 4; i++)
+    {
+        if(!isxdigit(s[i]))
+            return -1;
+        val = val * 16 + (isdigit(s[i]) ? s[i] - '0' : tolower(s[i]) - 'a' + 10);
+    }
+    return val;
+}
+
+/* read a quoted string starting at *s, and move *s past it. returns the unescaped copy, NULL if invalid */
+char *read_json_string(char **s)
+{
+    char *src = *s + 1, *dst, *res;
+    long code_point, low;
+
+    /* the unescaped string is never longer than the escaped one */
+    for(dst = src; *dst && *dst != '"'; dst += (*dst == '\\' && dst[1]) ? 2 : 1);
+    if(!*dst || !(res = malloc(dst - src + 1)))
+        return NULL;
+
+    for(dst = res; *src != '"'; src++)
+    {
+        if(*src != '\\')
+        {
+            *dst++ = *src;
+            continue;
+        }
+
+        switch(*++src)
+        {
+            case 'b': *dst++ = '\b'; break;
+            case 'f': *dst++ = '\f'; break;
+            case 'n': *dst++ = '\n'; break;
+            case 'r': *dst++ = '\r'; break;
+            case 't': *dst++ = '\t'; break;
+            case '"': case '\\': case '/': *dst++ = *src; break;
+            case 'u':
+                if((code_point = read_json_hex(src + 1)) < 0)
+                {
+                    free(res);
+                    return NULL;
+                }
+                src += 4;
+
+                /* join surrogate pairs into a single code point */
+                if(code_point >= 0xd800 && code_point < 0xdc00 && src[1] == '\\' && src[2] == 'u' &&
+                   (low = read_json_hex(src + 3)) >= 0xdc00 && low < 0xe000)
+                {
+                    code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                    src += 6;
+                }
+                dst += write_utf8(dst, code_point);
+                break;
+            default:
+                free(res);
+                return NULL;
+        }
+    }
+    *dst = '\x0';
+    *s = src + 1;
+    return res;
+}
+
+/* read the members of an object or items of an array, up to end. returns 1 on success, 0 otherwise */
+int parse_json_children(char **s, json_value *parent, char end, unsigned int depth)
+{
+    json_value **last = &parent->children;
+    char *key = NULL;
+
+    *s = skip_json_whitespaces(*s + 1);
+    if(**s == end)
+    {
+        (*s)++;
+        return 1;
+    }
+
+    while(1)
+    {
+        /* object members are named */
+        if(end == '}')
+        {
+            if(**s != '"' || !(key = read_json_string(s)))
+                return 0;
+            *s = skip_json_whitespaces(*s);
+            if(*(*s)++ != ':')
+            {
+                free(key);
+                return 0;
+            }
+        }
+
+        if(!(*last = parse_json_value(s, depth + 1)))
+        {
+            free(key);
+            return 0;
+        }
+        (*last)->key = key;
+        last = &(*last)->next;
+
+        *s = skip_json_whitespaces(*s);
+        if(**s == end)
+        {
+            (*s)++;
+            return 1;
+        }
+        if(*(*s)++ != ',')
+            return 0;
+        *s = skip_json_whitespaces(*s);
+    }
+}
+
+/* parse a single value starting at *s, and move *s past it. returns NULL if invalid */
+json_value *parse_json_value(char **s, unsigned int depth)
+{
+    json_value *value;
+    char *end;
+    int res = 1;
+
+    if(depth > JSON_MAX_DEPTH || !(value = calloc(1, sizeof(json_value))))
+        return NULL;
+
+    *s = skip_json_whitespaces(*s);
+    switch(**s)
+    {
+        case '{':
+            value->type = json_object;
+            res = parse_json_children(s, value, '}', depth);
+            break;
+        case '[':
+            value->type = json_array;
+            res = parse_json_children(s, value, ']', depth);
+            break;
+        case '"':
+            value->type = json_string;
+            res = (value->string = read_json_string(s)) != NULL;
+            break;
+        case 't':
+        case 'f':
+        case 'n':
+            value->type = **s == 'n' ? json_null : json_bool;
+            value->number = **s == 't';
+            end = **s == 't' ? "true" : **s == 'f' ? "false" : "null";
+            if((res = !strncmp(*s, end, strlen(end))))
+                *s += strlen(end);
+            break;
+        default:
+            value->type = json_number;
+            value->number = strtod(*s, &end);
+            res = end != *s;
+            *s = end;
+    }
+
+    if(!res)
+    {
+        free_json(value);
+        return NULL;
+    }
+    return value;
+}
+
+/* parse a whole json text. returns NULL if invalid */
+json_value *parse_json(char *text)
+{
+    json_value *value = parse_json_value(&text, 0);
+    if(value && *skip_json_whitespaces(text))
+    {
+        free_json(value);
+        value = NULL;
+    }
+    return value;
+}
+
+/* find a member of object by name. returns NULL if missing(or object is not an object) */
+json_value *json_member(json_value *object, char *key)
+{
+    json_value *curr;
+    if(!object || object->type != json_object)
+        return NULL;
+    for(curr = object->children; curr && strcmp(curr->key, key); curr = curr->next);
+    return curr;
+}
+
+/* returns the value of a string member, NULL if it's missing or not a string */
+char *json_member_string(json_value *object, char *key)
+{
+    json_value *member = json_member(object, key);
+    return member && member->type == json_string ? member->string : NULL;
+}
+
+/* returns the value of a number member, default_value if it's missing or not a number */
+long json_member_number(json_value *object, char *key, long default_value)
+{
+    json_value *member = json_member(object, key);
+    return member && member->type == json_number ? (long)member->number : default_value;
+}
+
+/* write len chars of s as a quoted json string */
+void write_json_string(FILE *fh, char *s, unsigned long len)
+{
+    putc('"', fh);
+    for(; len--; s++)
+    {
+        if(*s == '"' || *s == '\\')
+        {
+            putc('\\', fh);
+            putc(*s, fh);
+        }
+        else if((unsigned char)*s < 0x20)
+            fprintf(fh, "\\u%04x", (unsigned char)*s);
+        else
+            putc(*s, fh);
+    }
+    putc('"', fh);
+}
+
+/* write a value back as json text */
+void write_json_value(FILE *fh, json_value *value)
+{
+    json_value *curr;
+
+    switch(value->type)
+    {
+        case json_null:
+            fputs("null", fh);
+            break;
+        case json_bool:
+            fputs(value->number ? "true" : "false", fh);
+            break;
+        case json_number:
+            fprintf(fh, "%.17g", value->number);
+            break;
+        case json_string:
+            write_json_string(fh, value->string, strlen(value->string));
+            break;
+        case json_array:
+        case json_object:
+            putc(value->type == json_array ? '[' : '{', fh);
+            for(curr = value->children; curr; curr = curr->next)
+            {
+                if(curr != value->children)
+                    putc(',', fh);
+                if(curr->key)
+                {
+                    write_json_string(fh, curr->key, strlen(curr->key));
+                    putc(':', fh);
+                }
+                write_json_value(fh, curr);
+            }
+            putc(value->type == json_array ? ']' : '}', fh);
+            break;
+    }
+}
+
+/* free a value and everything in it */
+void free_json(json_value *value)
+{
+    json_value *next;
+    while(value)
+    {
+        free_json(value->children);
+        free(value->string);
+        free(value->key);
+        next = value->next;
+        free(value);
+        value = next;
+    }
+}
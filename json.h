@@ -0,0 +1,32 @@
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <stdio.h>
+
+typedef enum {
+    json_null,
+    json_bool,
+    json_number,
+    json_string,
+    json_array,
+    json_object
+} json_type;
+
+typedef struct json_value_ {
+    json_type type;
+    double number; /* value of numbers, 0/1 for bools */
+    char *string; /* value of strings */
+    char *key; /* name of this member, NULL outside objects */
+    struct json_value_ *children; /* members of objects and items of arrays, in order */
+    struct json_value_ *next;
+} json_value;
+
+json_value *parse_json(char *text);
+json_value *json_member(json_value *object, char *key);
+char *json_member_string(json_value *object, char *key);
+long json_member_number(json_value *object, char *key, long default_value);
+void write_json_string(FILE *fh, char *s, unsigned long len);
+void write_json_value(FILE *fh, json_value *value);
+void free_json(json_value *value);
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "linked_list.h"
 #include "errors.h"
+#include "alloc_tracking.h"
 
 /* initialize list */
 void init_list(list *list_)
@@ -42,6 +43,16 @@ int insert(list *list_, void *data)
     return res;
 }
 
+/* returns number of items in this list */
+unsigned int list_length(list *list_)
+{
+    unsigned int length = 0;
+    node *curr;
+    for(curr = list_->head; curr; curr = curr->next)
+        length++;
+    return length;
+}
+
 /* returns a pointer to the head node of this list */
 void *get_head(list *list_)
 {
@@ -14,6 +14,7 @@ typedef struct {
 void init_list(list *list_);
 int is_empty(list *list_);
 int insert(list *list_, void *data);
+unsigned int list_length(list *list_);
 void *get_head(list *list_);
 void *get_tail(list *list_);
 
@@ -0,0 +1,1066 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "json.h"
+#include "first_pass.h"
+#include "memory_map.h"
+#include "symbols_table.h"
+#include "utilities.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/*
+ * language server(LSP, json-rpc over stdio) for assembly sources.
+ * every open document keeps the analysis of each of its lines, and an edit analyzes again only the lines
+ * it replaced. the names used by a document are interned in a hash table and lines point to their entries,
+ * so publishing diagnostics and answering queries never parse or hash the whole text again.
+ * every symbol links the names defining and using it, and the lines keep the words before them in a gap buffer,
+ * so queries never walk the lines either. an edit checks again only its own lines and the lines using the symbols
+ * it defined or undefined, and diagnostics are published only when they change.
+ * positions are counted in bytes, which is the same as utf-16 units for the ascii sources we accept.
+ */
+
+#define LSP_HEADER_MAX 256
+#define LSP_INITIAL_LINES 256
+#define LSP_INITIAL_NAMES 256 /* must be a power of 2 */
+#define LSP_CODE_BASE 100 /* where the code segment starts, the data segment follows it */
+#define LSP_SEGMENTS 2 /* code and data, the segments lines have words in */
+#define LSP_LINE_DIAGNOSTICS 2 /* the error of a line itself, and a symbol it uses which is never defined */
+
+/* json-rpc error codes */
+#define RPC_PARSE_ERROR -32700
+#define RPC_INVALID_REQUEST -32600
+#define RPC_METHOD_NOT_FOUND -32601
+
+typedef struct lsp_symbol_ {
+    char name[MAX_LABEL_LEN + 1];
+    struct lsp_name_ *definitions; /* names defining it, as a label, an external or by an included file */
+    struct lsp_name_ *uses; /* operands and .entry lines naming it */
+    unsigned int entries; /* .entry lines naming it */
+    struct lsp_symbol_ *next_touched; /* the symbols which became defined or undefined by the current edit */
+    unsigned int touched:1;
+} lsp_symbol;
+
+/* a name on a line and where it starts, linked with the other names of its symbol */
+typedef struct lsp_name_ {
+    lsp_symbol *symbol; /* NULL if unused */
+    struct lsp_line_ *line;
+    unsigned int column;
+    unsigned int len;
+    struct lsp_name_ *prev;
+    struct lsp_name_ *next;
+} lsp_name;
+
+/* a name defined by an included file */
+typedef struct {
+    lsp_name name; /* at the path of the included file */
+    unsigned int offset; /* from the first word of the included file */
+    symbol_type type;
+} lsp_included_name;
+
+typedef struct lsp_line_ {
+    char *text;
+    int error; /* SUCCESS or the error code of this line */
+    int diagnostics[LSP_LINE_DIAGNOSTICS]; /* the errors published for it, in the order the assembler reports them */
+    unsigned int number_of_diagnostics;
+    unsigned int slot; /* where it is in the lines of its document */
+    unsigned int words[LSP_SEGMENTS]; /* of code and of data on the lines before it, or from it to the end after the gap */
+    unsigned int size; /* number of words this line takes */
+    symbol_type segment; /* code or data, where those words go */
+    lsp_name label;
+    lsp_name external; /* name declared by .extern */
+    lsp_name references[MAX_REFERENCES]; /* symbols used by the operands, or the name of an .entry */
+    lsp_name included_path; /* file of an .include, where the names it defines point to */
+    lsp_included_name *included;
+    unsigned int number_of_included;
+    unsigned int is_entry:1;
+    unsigned int missing_entry:1; /* .entry of a name which can never be a symbol */
+    struct lsp_line_ *prev_diagnostic; /* the lines with a diagnostic, in no order */
+    struct lsp_line_ *next_diagnostic;
+} lsp_line;
+
+typedef struct lsp_document_ {
+    char *uri;
+    lsp_line **lines; /* with a gap where the last edit was, only the lines moved across it change */
+    unsigned int number_of_lines;
+    unsigned int capacity;
+    unsigned int gap_start;
+    unsigned int gap_end; /* first line after the gap */
+    unsigned int before_gap[LSP_SEGMENTS]; /* words of code and of data on the lines before the gap */
+    unsigned int after_gap[LSP_SEGMENTS];
+    lsp_symbol **names; /* open addressing hash table, never more than half full */
+    unsigned long names_mask;
+    unsigned long number_of_names;
+    lsp_line *diagnostics; /* the lines with a diagnostic */
+    lsp_symbol *touched;
+    unsigned int diagnostics_changed:1; /* since they were last published */
+    struct lsp_document_ *next;
+} lsp_document;
+
+/* a message being written, sent once complete since the header needs its length */
+typedef struct {
+    FILE *fh;
+    char *text;
+    size_t size;
+} lsp_message;
+
+lsp_document *documents = NULL;
+int shutdown_requested = 0;
+
+/* find a name in the document. returns NULL if it was never used */
+lsp_symbol *find_name(lsp_document *doc, char *name, unsigned int len)
+{
+    unsigned long i;
+    char tmp[MAX_LABEL_LEN + 1];
+
+    if(len > MAX_LABEL_LEN || !doc->names)
+        return NULL;
+    memcpy(tmp, name, len);
+    tmp[len] = '\x0';
+
+    for(i = hash_string(tmp) & doc->names_mask; doc->names[i]; i = (i + 1) & doc->names_mask)
+    {
+        if(!strcmp(doc->names[i]->name, tmp))
+            return doc->names[i];
+    }
+    return NULL;
+}
+
+/* insert symbol to the hash table, which has room for it */
+void insert_name(lsp_symbol **names, unsigned long mask, lsp_symbol *symbol)
+{
+    unsigned long i;
+    for(i = hash_string(symbol->name) & mask; names[i]; i = (i + 1) & mask);
+    names[i] = symbol;
+}
+
+/* find a name in the document, adding it if it's new. returns NULL on failure(or names too long to be symbols) */
+lsp_symbol *intern_name(lsp_document *doc, char *name, unsigned int len)
+{
+    lsp_symbol *symbol, **names;
+    unsigned long i, size;
+
+    if(len > MAX_LABEL_LEN)
+        return NULL;
+    if((symbol = find_name(doc, name, len)))
+        return symbol;
+
+    /* keep the table at most half full */
+    if(!doc->names || (doc->number_of_names + 1) * 2 > doc->names_mask + 1)
+    {
+        size = doc->names ? (doc->names_mask + 1) * 2 : LSP_INITIAL_NAMES;
+        if(!(names = calloc(size, sizeof(lsp_symbol *))))
+            return NULL;
+        for(i = 0; doc->names && i <= doc->names_mask; i++)
+        {
+            if(doc->names[i])
+                insert_name(names, size - 1, doc->names[i]);
+        }
+        free(doc->names);
+        doc->names = names;
+        doc->names_mask = size - 1;
+    }
+
+    if(!(symbol = calloc(1, sizeof(lsp_symbol))))
+        return NULL;
+    memcpy(symbol->name, name, len);
+    insert_name(doc->names, doc->names_mask, symbol);
+    doc->number_of_names++;
+    return symbol;
+}
+
+/* find name as a whole word in text, starting from offset. returns its offset, or offset if it's not there */
+unsigned int find_word(char *text, unsigned int offset, char *name)
+{
+    char *curr;
+    unsigned int len = strlen(name);
+
+    for(curr = text + offset; (curr = strstr(curr, name)); curr++)
+    {
+        if((curr == text || !isalnum((unsigned char)curr[-1])) && !isalnum((unsigned char)curr[len]))
+            return curr - text;
+    }
+    return offset;
+}
+
+/* set where a name is used by a line */
+void set_name(lsp_document *doc, lsp_name *dst, char *text, unsigned int column, unsigned int len)
+{
+    dst->symbol = intern_name(doc, text + column, len);
+    dst->column = column;
+    dst->len = len;
+}
+
+/* a symbol which becomes defined or undefined is touched, the lines using it are checked again once the edit is done */
+void touch_symbol(lsp_document *doc, lsp_symbol *symbol)
+{
+    if(symbol->touched)
+        return;
+    symbol->touched = 1;
+    symbol->next_touched = doc->touched;
+    doc->touched = symbol;
+}
+
+/* add(link 1) or remove(link 0) a name of line from the definitions or the uses of its symbol */
+void link_name(lsp_document *doc, lsp_line *line, lsp_name *name, int is_definition, int link)
+{
+    lsp_name **head;
+
+    if(!name->symbol)
+        return;
+    head = is_definition ? &name->symbol->definitions : &name->symbol->uses;
+    if(link)
+    {
+        name->line = line;
+        name->prev = NULL;
+        if((name->next = *head))
+            (*head)->prev = name;
+        *head = name;
+    }
+    else
+    {
+        if(name->prev)
+            name->prev->next = name->next;
+        else
+            *head = name->next;
+        if(name->next)
+            name->next->prev = name->prev;
+    }
+
+    /* the first definition was added or the last one removed */
+    if(is_definition && (link ? !name->next : !*head))
+        touch_symbol(doc, name->symbol);
+}
+
+/* add(link 1) or remove(link 0) the names of a line from their symbols */
+void link_line_names(lsp_document *doc, lsp_line *line, int link)
+{
+    unsigned int i;
+
+    link_name(doc, line, &line->label, 1, link);
+    link_name(doc, line, &line->external, 1, link);
+    for(i = 0; i < MAX_REFERENCES; i++)
+        link_name(doc, line, line->references + i, 0, link);
+    for(i = 0; i < line->number_of_included; i++)
+        link_name(doc, line, &line->included[i].name, 1, link);
+    if(line->is_entry && line->references[0].symbol)
+        line->references[0].symbol->entries += link ? 1 : -1;
+}
+
+/* add the names defined by an included file to line, from the table the reader added them to. they point to the path */
+void set_included_names(lsp_document *doc, lsp_line *line, symbol_table *symbols)
+{
+    node *curr;
+    unsigned int count = 0;
+    lsp_included_name *included;
+
+    for(curr = symbols->symbols.head; curr; curr = curr->next, count++);
+    if(!count || !(line->included = malloc(count * sizeof(lsp_included_name))))
+        return;
+    for(curr = symbols->symbols.head; curr; curr = curr->next, line->number_of_included++)
+    {
+        included = line->included + line->number_of_included;
+        set_name(doc, &included->name, ((symbol_entry *)curr->data)->name, 0, strlen(((symbol_entry *)curr->data)->name));
+        included->name.column = line->included_path.column;
+        included->name.len = line->included_path.len;
+        included->offset = ((symbol_entry *)curr->data)->offset;
+        included->type = ((symbol_entry *)curr->data)->type;
+    }
+}
+
+/* the errors of line, like the assembler would report them. returns their number */
+unsigned int line_diagnostics(lsp_line *line, int *diagnostics)
+{
+    unsigned int i, number_of_diagnostics = 0;
+
+    if(line->error != SUCCESS)
+        diagnostics[number_of_diagnostics++] = line->error;
+
+    /* symbols which are never defined, once per line like the second pass. a name defined again isn't an error,
+     * the assembler uses its first definition */
+    for(i = 0; i < MAX_REFERENCES; i++)
+    {
+        if((line->references[i].symbol && !line->references[i].symbol->definitions) || (i == 0 && line->missing_entry))
+        {
+            diagnostics[number_of_diagnostics++] = ERR_MISSING_SYMBOL;
+            break;
+        }
+    }
+    return number_of_diagnostics;
+}
+
+/* set the diagnostics of line, keeping the list of the lines which have any */
+void set_diagnostics(lsp_document *doc, lsp_line *line, int *diagnostics, unsigned int number_of_diagnostics)
+{
+    if(line->number_of_diagnostics == number_of_diagnostics &&
+       (!number_of_diagnostics || !memcmp(line->diagnostics, diagnostics, number_of_diagnostics * sizeof(int))))
+        return;
+    if(!line->number_of_diagnostics)
+    {
+        line->prev_diagnostic = NULL;
+        if((line->next_diagnostic = doc->diagnostics))
+            doc->diagnostics->prev_diagnostic = line;
+        doc->diagnostics = line;
+    }
+    else if(!number_of_diagnostics)
+    {
+        if(line->prev_diagnostic)
+            line->prev_diagnostic->next_diagnostic = line->next_diagnostic;
+        else
+            doc->diagnostics = line->next_diagnostic;
+        if(line->next_diagnostic)
+            line->next_diagnostic->prev_diagnostic = line->prev_diagnostic;
+    }
+    if(number_of_diagnostics)
+        memcpy(line->diagnostics, diagnostics, number_of_diagnostics * sizeof(int));
+    line->number_of_diagnostics = number_of_diagnostics;
+    doc->diagnostics_changed = 1;
+}
+
+/* check line for the errors it has now */
+void update_diagnostics(lsp_document *doc, lsp_line *line)
+{
+    int diagnostics[LSP_LINE_DIAGNOSTICS];
+    set_diagnostics(doc, line, diagnostics, line_diagnostics(line, diagnostics));
+}
+
+void free_line(lsp_line *line)
+{
+    free(line->text);
+    free(line->included);
+    free(line);
+}
+
+/* returns the line at line_number */
+lsp_line *line_at(lsp_document *doc, unsigned int line_number)
+{
+    return doc->lines[line_number < doc->gap_start ? line_number : line_number + doc->gap_end - doc->gap_start];
+}
+
+/* returns the number of line in its document */
+unsigned int line_number_of(lsp_document *doc, lsp_line *line)
+{
+    return line->slot < doc->gap_start ? line->slot : line->slot - (doc->gap_end - doc->gap_start);
+}
+
+/* returns the words of segment on the lines before line */
+unsigned int words_before(lsp_document *doc, lsp_line *line, symbol_type segment)
+{
+    if(line->slot < doc->gap_start)
+        return line->words[segment];
+    return doc->before_gap[segment] + doc->after_gap[segment] - line->words[segment];
+}
+
+/* move the gap to be before line_number. the lines moved across it count their words from the other side */
+void move_gap(lsp_document *doc, unsigned int line_number)
+{
+    lsp_line *line;
+
+    while(doc->gap_start > line_number)
+    {
+        line = doc->lines[--doc->gap_end] = doc->lines[--doc->gap_start];
+        line->slot = doc->gap_end;
+        doc->before_gap[line->segment] -= line->size;
+        doc->after_gap[line->segment] += line->size;
+        line->words[code] = doc->after_gap[code];
+        line->words[data] = doc->after_gap[data];
+    }
+    while(doc->gap_start < line_number)
+    {
+        line = doc->lines[doc->gap_start++] = doc->lines[doc->gap_end++];
+        line->slot = doc->gap_start - 1;
+        line->words[code] = doc->before_gap[code];
+        line->words[data] = doc->before_gap[data];
+        doc->before_gap[line->segment] += line->size;
+        doc->after_gap[line->segment] -= line->size;
+    }
+}
+
+/* remove the line right after the gap from the document's symbols and diagnostics, and free it */
+void drop_line(lsp_document *doc)
+{
+    lsp_line *line = doc->lines[doc->gap_end++];
+
+    doc->after_gap[line->segment] -= line->size;
+    doc->number_of_lines--;
+    link_line_names(doc, line, 0);
+    set_diagnostics(doc, line, NULL, 0);
+    free_line(line);
+}
+
+/* analyze a single line with the first pass readers, without encoding it */
+void analyze_line(lsp_document *doc, lsp_line *line)
+{
+    char *buf, *s, *sep, *name, *text = line->text;
+    int res = SUCCESS, i, tmp;
+    unsigned int column;
+    symbol_reference references[MAX_REFERENCES];
+    symbol_table scratch;
+
+    memset(line, 0, sizeof(lsp_line));
+    line->text = text;
+    line->error = SUCCESS;
+    line->segment = data;
+
+    /* the readers split the line in place, keep the text for the editor. they expect the newline read_line keeps */
+    if(!(buf = malloc(strlen(line->text) + 2)))
+    {
+        line->error = ERR_MEM_ALLOC_FAILED;
+        return;
+    }
+    strcpy(buf, line->text);
+    strcat(buf, "\n");
+
+    /* skip blank lines and comments */
+    if(!*(s = skip_whitespaces(buf)) || *s == ';')
+    {
+        free(buf);
+        return;
+    }
+
+    /* check for label at the start of this line */
+    if((sep = strchr(s, ':')))
+    {
+        *sep = '\x0';
+        if((res = is_valid_label(s)) == OK)
+            set_name(doc, &line->label, buf, s - buf, sep - s);
+        s = skip_whitespaces(sep + 1);
+    }
+
+    if(*s == '.')
+    {
+        column = skip_word(s) - buf;
+        switch(read_guide_statement_type(s))
+        {
+            case GUIDE_ENTRY:
+                /* the same name the second pass looks for */
+                name = skip_whitespaces(s + strlen(".entry"));
+                for(sep = name; *sep && !isspace(*sep); sep++);
+                set_name(doc, &line->references[0], buf, name - buf, sep - name);
+                line->is_entry = 1;
+                line->missing_entry = !line->references[0].symbol;
+                break;
+
+            case GUIDE_EXTERN:
+                /* let the reader add the symbol to a scratch table and take it from there */
+                init_symbol_table(&scratch);
+                if((tmp = read_guide_line(NULL, s, &scratch)) == 0 && scratch.symbols.head)
+                {
+                    name = ((symbol_entry *)scratch.symbols.head->data)->name;
+                    set_name(doc, &line->external, line->text, find_word(line->text, column, name), strlen(name));
+                }
+                free_symbols_table(&scratch);
+                if(res == OK)
+                    res = tmp;
+                break;
+
+            case GUIDE_INCLUDE:
+                /* the names come from the cache of included files, like when assembling */
+                init_symbol_table(&scratch);
+                name = skip_whitespaces(buf + column);
+                for(sep = name + 1; *sep && *sep != '"'; sep++);
+                if((tmp = read_guide_line(NULL, s, &scratch)) >= 0)
+                {
+                    line->size = tmp;
+                    line->included_path.column = name - buf;
+                    line->included_path.len = sep - name + (*sep == '"');
+                    set_included_names(doc, line, &scratch);
+                }
+                free_symbols_table(&scratch);
+                if(res == OK)
+                    res = tmp;
+                break;
+
+            default:
+                if((tmp = read_guide_line(NULL, s, NULL)) > 0)
+                    line->size = tmp;
+                if(res == OK)
+                    res = tmp;
+        }
+    }
+    else
+    {
+        line->segment = code;
+        column = skip_word(s) - buf;
+        if((tmp = read_instruction_line(NULL, references, s)) > 0)
+        {
+            line->size = tmp;
+
+            /* find the operands in the text, in order */
+            for(i = 0; i < MAX_REFERENCES && references[i].symbol_name[0]; i++)
+            {
+                column = find_word(line->text, column, references[i].symbol_name);
+                set_name(doc, &line->references[i], line->text, column, strlen(references[i].symbol_name));
+                column += line->references[i].len;
+            }
+        }
+        if(res == OK)
+            res = tmp;
+    }
+
+    line->error = res < 0 ? res : SUCCESS;
+    link_line_names(doc, line, 1);
+    free(buf);
+}
+
+/* replace number_removed lines starting at first with the lines of text. returns SUCCESS on success, error code otherwise */
+int splice_lines(lsp_document *doc, unsigned int first, unsigned int number_removed, char *text)
+{
+    unsigned int i, number_added = 1, capacity;
+    lsp_line **lines, *line;
+    lsp_symbol *symbol;
+    lsp_name *name;
+    char *end;
+    int res = SUCCESS;
+
+    for(end = text; (end = strchr(end, '\n')); end++)
+        number_added++;
+
+    /* make room for the new lines, the lines after the gap move to the end */
+    if(doc->number_of_lines - number_removed + number_added > doc->capacity)
+    {
+        for(capacity = doc->capacity ? doc->capacity : LSP_INITIAL_LINES; capacity < doc->number_of_lines - number_removed + number_added; capacity *= 2);
+        if(!(lines = realloc(doc->lines, capacity * sizeof(lsp_line *))))
+            return ERR_MEM_ALLOC_FAILED;
+        memmove(lines + doc->gap_end + capacity - doc->capacity, lines + doc->gap_end, (doc->capacity - doc->gap_end) * sizeof(lsp_line *));
+        doc->gap_end += capacity - doc->capacity;
+        for(i = doc->gap_end; i < capacity; i++)
+            lines[i]->slot = i;
+        doc->lines = lines;
+        doc->capacity = capacity;
+    }
+
+    /* the removed lines are right after the gap, and the new ones are added before it */
+    move_gap(doc, first);
+    for(i = 0; i < number_removed; i++)
+        drop_line(doc);
+
+    /* analyze only the new lines */
+    for(i = 0; i < number_added; i++)
+    {
+        for(end = text; *end && *end != '\n'; end++);
+        if(!(line = malloc(sizeof(lsp_line))) || !(line->text = malloc(end - text + 1)))
+        {
+            /* the document can't be kept whole, drop the rest of it */
+            free(line);
+            while(doc->gap_end < doc->capacity)
+                drop_line(doc);
+            res = ERR_MEM_ALLOC_FAILED;
+            break;
+        }
+        memcpy(line->text, text, end - text);
+        line->text[end - text - (end > text && end[-1] == '\r')] = '\x0';
+        analyze_line(doc, line);
+
+        line->slot = doc->gap_start;
+        line->words[code] = doc->before_gap[code];
+        line->words[data] = doc->before_gap[data];
+        doc->before_gap[line->segment] += line->size;
+        doc->lines[doc->gap_start++] = line;
+        doc->number_of_lines++;
+        text = *end ? end + 1 : end;
+    }
+
+    /* check the new lines, and the lines using the symbols which became defined or undefined */
+    for(i = doc->gap_start - i; i < doc->gap_start; i++)
+        update_diagnostics(doc, doc->lines[i]);
+    while((symbol = doc->touched))
+    {
+        doc->touched = symbol->next_touched;
+        symbol->touched = 0;
+        for(name = symbol->uses; name; name = name->next)
+            update_diagnostics(doc, name->line);
+    }
+
+    /* the diagnostics after the edit moved to other lines */
+    for(line = doc->diagnostics; line && number_added != number_removed; line = line->next_diagnostic)
+    {
+        if(line->slot >= doc->gap_end)
+        {
+            doc->diagnostics_changed = 1;
+            break;
+        }
+    }
+    return res;
+}
+
+/* apply a single change of the editor to the document */
+int apply_change(lsp_document *doc, json_value *change)
+{
+    json_value *range = json_member(change, "range");
+    char *text = json_member_string(change, "text"), *joined;
+    unsigned int start_line, start_char, end_line, end_char, len;
+    int res;
+
+    if(!text)
+        return ERR_INVALID_VALUE;
+
+    /* no range means the whole document */
+    if(!range || !doc->number_of_lines)
+        return splice_lines(doc, 0, doc->number_of_lines, text);
+
+    start_line = json_member_number(json_member(range, "start"), "line", 0);
+    start_char = json_member_number(json_member(range, "start"), "character", 0);
+    end_line = json_member_number(json_member(range, "end"), "line", 0);
+    end_char = json_member_number(json_member(range, "end"), "character", 0);
+    if(end_line >= doc->number_of_lines)
+    {
+        end_line = doc->number_of_lines - 1;
+        end_char = strlen(line_at(doc, end_line)->text);
+    }
+    if(start_line > end_line)
+        return ERR_INVALID_VALUE;
+    if(start_char > strlen(line_at(doc, start_line)->text))
+        start_char = strlen(line_at(doc, start_line)->text);
+    if(end_char > strlen(line_at(doc, end_line)->text))
+        end_char = strlen(line_at(doc, end_line)->text);
+
+    /* the first line up to the change, the new text, then the last line after it */
+    len = strlen(text) + start_char + strlen(line_at(doc, end_line)->text + end_char);
+    if(!(joined = malloc(len + 1)))
+        return ERR_MEM_ALLOC_FAILED;
+    memcpy(joined, line_at(doc, start_line)->text, start_char);
+    strcpy(joined + start_char, text);
+    strcat(joined, line_at(doc, end_line)->text + end_char);
+
+    res = splice_lines(doc, start_line, end_line - start_line + 1, joined);
+    free(joined);
+    return res;
+}
+
+/* returns the document of uri, NULL if it's not open */
+lsp_document *find_document(char *uri)
+{
+    lsp_document *doc;
+    for(doc = documents; doc && uri && strcmp(doc->uri, uri); doc = doc->next);
+    return uri ? doc : NULL;
+}
+
+void free_document(lsp_document *doc)
+{
+    unsigned int i;
+    for(i = 0; i < doc->number_of_lines; i++)
+        free_line(line_at(doc, i));
+    for(i = 0; doc->names && i <= doc->names_mask; i++)
+        free(doc->names[i]);
+    free(doc->names);
+    free(doc->lines);
+    free(doc->uri);
+    free(doc);
+}
+
+/* start writing a message. returns SUCCESS on success, error code otherwise */
+int start_message(lsp_message *msg)
+{
+    if(!(msg->fh = open_memstream(&msg->text, &msg->size)))
+        return ERR_MEM_ALLOC_FAILED;
+    fputs("{\"jsonrpc\":\"2.0\",", msg->fh);
+    return SUCCESS;
+}
+
+/* finish a message and send it with its header */
+void send_message(lsp_message *msg)
+{
+    fputc('}', msg->fh);
+    if(fclose(msg->fh) == 0)
+    {
+        printf("Content-Length: %lu\r\n\r\n", (unsigned long)msg->size);
+        fwrite(msg->text, 1, msg->size, stdout);
+        fflush(stdout);
+    }
+
+    /* the stream's buffer comes from the c library, it isn't tracked */
+    (free)(msg->text);
+}
+
+/* start the response of a request, the result value is written next */
+int start_response(lsp_message *msg, json_value *id)
+{
+    if(start_message(msg) != SUCCESS)
+        return ERR_MEM_ALLOC_FAILED;
+    fputs("\"id\":", msg->fh);
+    if(id)
+        write_json_value(msg->fh, id);
+    else
+        fputs("null", msg->fh);
+    fputs(",\"result\":", msg->fh);
+    return SUCCESS;
+}
+
+void send_error(json_value *id, int code, char *message)
+{
+    lsp_message msg;
+    if(start_message(&msg) == SUCCESS)
+    {
+        fputs("\"id\":", msg.fh);
+        if(id)
+            write_json_value(msg.fh, id);
+        else
+            fputs("null", msg.fh);
+        fprintf(msg.fh, ",\"error\":{\"code\":%d,\"message\":", code);
+        write_json_string(msg.fh, message, strlen(message));
+        fputc('}', msg.fh);
+        send_message(&msg);
+    }
+}
+
+void write_range(FILE *fh, unsigned int line_number, unsigned int start, unsigned int end)
+{
+    fprintf(fh, "{\"start\":{\"line\":%u,\"character\":%u},\"end\":{\"line\":%u,\"character\":%u}}", line_number, start, line_number, end);
+}
+
+void write_location(FILE *fh, lsp_document *doc, lsp_name *name)
+{
+    fputs("{\"uri\":", fh);
+    write_json_string(fh, doc->uri, strlen(doc->uri));
+    fputs(",\"range\":", fh);
+    write_range(fh, line_number_of(doc, name->line), name->column, name->column + name->len);
+    fputc('}', fh);
+}
+
+void write_diagnostic(FILE *fh, int *first, lsp_document *doc, lsp_line *line, int diagnostic)
+{
+    char *message = error_code_to_string(diagnostic);
+    fputs(*first ? "{\"range\":" : ",{\"range\":", fh);
+    write_range(fh, line_number_of(doc, line), 0, strlen(line->text));
+    fputs(",\"severity\":1,\"source\":\"assembler\",\"message\":", fh);
+    write_json_string(fh, message, strlen(message));
+    fputc('}', fh);
+    *first = 0;
+}
+
+/* publish the errors of the document, like the assembler would report them */
+void publish_diagnostics(lsp_document *doc)
+{
+    lsp_message msg;
+    lsp_line *line;
+    unsigned int i;
+    int first = 1;
+
+    if(start_message(&msg) != SUCCESS)
+        return;
+    fputs("\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", msg.fh);
+    write_json_string(msg.fh, doc->uri, strlen(doc->uri));
+    fputs(",\"diagnostics\":[", msg.fh);
+    for(line = doc->diagnostics; line; line = line->next_diagnostic)
+    {
+        for(i = 0; i < line->number_of_diagnostics; i++)
+            write_diagnostic(msg.fh, &first, doc, line, line->diagnostics[i]);
+    }
+    fputs("]}", msg.fh);
+    send_message(&msg);
+    doc->diagnostics_changed = 0;
+}
+
+/* find the name under position. returns its symbol, or NULL if there's none */
+lsp_symbol *symbol_at(lsp_document *doc, json_value *position, unsigned int *line_number, lsp_name *name)
+{
+    char *text;
+    unsigned int start, end;
+
+    *line_number = json_member_number(position, "line", 0);
+    if(!doc || *line_number >= doc->number_of_lines)
+        return NULL;
+    text = line_at(doc, *line_number)->text;
+    start = json_member_number(position, "character", 0);
+    if(start > strlen(text))
+        return NULL;
+
+    for(end = start; isalnum((unsigned char)text[end]); end++);
+    for(; start && isalnum((unsigned char)text[start - 1]); start--);
+    name->column = start;
+    name->len = end - start;
+    return (name->symbol = find_name(doc, text + start, end - start));
+}
+
+/* find the name defining symbol, the first one in the document like the assembler. returns NULL if it isn't defined */
+lsp_name *find_definition(lsp_symbol *symbol)
+{
+    lsp_name *curr, *definition = symbol ? symbol->definitions : NULL;
+
+    /* slots keep the order of the lines. names are linked to the front in the order of their line, its first is found last */
+    for(curr = definition; curr; curr = curr->next)
+    {
+        if(curr->line->slot <= definition->line->slot)
+            definition = curr;
+    }
+    return definition;
+}
+
+/* address of the words of a line, after all the code comes the data */
+unsigned int line_address(lsp_document *doc, lsp_line *line)
+{
+    if(line->segment == code)
+        return LSP_CODE_BASE + words_before(doc, line, code);
+    return LSP_CODE_BASE + doc->before_gap[code] + doc->after_gap[code] + words_before(doc, line, data);
+}
+
+/* order names by where they are in the document */
+int compare_names(const void *a, const void *b)
+{
+    lsp_name *first = *(lsp_name **)a, *second = *(lsp_name **)b;
+
+    if(first->line->slot != second->line->slot)
+        return first->line->slot < second->line->slot ? -1 : 1;
+    return first->column < second->column ? -1 : first->column > second->column;
+}
+
+void handle_definition(json_value *id, json_value *params)
+{
+    lsp_document *doc = find_document(json_member_string(json_member(params, "textDocument"), "uri"));
+    lsp_name name, *definition;
+    unsigned int line_number;
+    lsp_message msg;
+
+    if(start_response(&msg, id) != SUCCESS)
+        return;
+    if((definition = find_definition(symbol_at(doc, json_member(params, "position"), &line_number, &name))))
+        write_location(msg.fh, doc, definition);
+    else
+        fputs("null", msg.fh);
+    send_message(&msg);
+}
+
+void handle_references(json_value *id, json_value *params)
+{
+    lsp_document *doc = find_document(json_member_string(json_member(params, "textDocument"), "uri"));
+    json_value *declarations = json_member(json_member(params, "context"), "includeDeclaration");
+    lsp_symbol *symbol;
+    lsp_name name, *curr, **found = NULL;
+    unsigned int i, count = 0, line_number;
+    lsp_message msg;
+
+    if(start_response(&msg, id) != SUCCESS)
+        return;
+    fputc('[', msg.fh);
+    if((symbol = symbol_at(doc, json_member(params, "position"), &line_number, &name)))
+    {
+        /* the uses of the symbol, and its definitions if asked for, in the order of the document */
+        for(i = 0; i < 2; i++)
+        {
+            for(curr = i ? symbol->definitions : symbol->uses; curr && (!i || (declarations && declarations->number)); curr = curr->next)
+                count++;
+        }
+        if(count && (found = malloc(count * sizeof(lsp_name *))))
+        {
+            for(i = 0, count = 0; i < 2; i++)
+            {
+                for(curr = i ? symbol->definitions : symbol->uses; curr && (!i || (declarations && declarations->number)); curr = curr->next)
+                    found[count++] = curr;
+            }
+            qsort(found, count, sizeof(lsp_name *), compare_names);
+            for(i = 0; i < count; i++)
+            {
+                if(i)
+                    fputc(',', msg.fh);
+                write_location(msg.fh, doc, found[i]);
+            }
+            free(found);
+        }
+    }
+    fputc(']', msg.fh);
+    send_message(&msg);
+}
+
+void handle_hover(json_value *id, json_value *params)
+{
+    lsp_document *doc = find_document(json_member_string(json_member(params, "textDocument"), "uri"));
+    lsp_symbol *symbol;
+    lsp_name name, *definition;
+    lsp_included_name *included;
+    lsp_line *line;
+    unsigned int line_number;
+    lsp_message msg;
+    char value[MAX_LABEL_LEN + 64];
+
+    if(start_response(&msg, id) != SUCCESS)
+        return;
+    if((symbol = symbol_at(doc, json_member(params, "position"), &line_number, &name)) && (definition = find_definition(symbol)))
+    {
+        /* a name which is neither the label nor the external of its line was defined by an included file */
+        line = definition->line;
+        included = definition != &line->label && definition != &line->external ? (lsp_included_name *)definition : NULL;
+        if(definition == &line->external || (included && included->type == external))
+            sprintf(value, "`%s` external symbol", symbol->name);
+        else if(included)
+            sprintf(value, "`%s` data label, address %u%s", symbol->name, line_address(doc, line) + included->offset,
+                    symbol->entries ? ", entry" : "");
+        else
+            sprintf(value, "`%s` %s label, address %u%s", symbol->name, line->segment == code ? "code" : "data",
+                    line_address(doc, line), symbol->entries ? ", entry" : "");
+
+        fputs("{\"contents\":{\"kind\":\"markdown\",\"value\":", msg.fh);
+        write_json_string(msg.fh, value, strlen(value));
+        fputs("},\"range\":", msg.fh);
+        write_range(msg.fh, line_number, name.column, name.column + name.len);
+        fputc('}', msg.fh);
+    }
+    else
+    {
+        fputs("null", msg.fh);
+    }
+    send_message(&msg);
+}
+
+void handle_did_open(json_value *params)
+{
+    json_value *text_document = json_member(params, "textDocument");
+    char *uri = json_member_string(text_document, "uri"), *text = json_member_string(text_document, "text");
+    lsp_document *doc;
+
+    if(!uri || !text || find_document(uri) || !(doc = calloc(1, sizeof(lsp_document))))
+        return;
+    if(!(doc->uri = malloc(strlen(uri) + 1)))
+    {
+        free(doc);
+        return;
+    }
+    strcpy(doc->uri, uri);
+    doc->next = documents;
+    documents = doc;
+
+    splice_lines(doc, 0, 0, text);
+    publish_diagnostics(doc);
+}
+
+void handle_did_change(json_value *params)
+{
+    lsp_document *doc = find_document(json_member_string(json_member(params, "textDocument"), "uri"));
+    json_value *changes = json_member(params, "contentChanges"), *curr;
+
+    if(!doc || !changes || changes->type != json_array)
+        return;
+    for(curr = changes->children; curr; curr = curr->next)
+        apply_change(doc, curr);
+
+    /* the client keeps what was published last, until it changes */
+    if(doc->diagnostics_changed)
+        publish_diagnostics(doc);
+}
+
+void handle_did_close(json_value *params)
+{
+    char *uri = json_member_string(json_member(params, "textDocument"), "uri");
+    lsp_document **curr, *doc;
+    lsp_message msg;
+
+    for(curr = &documents; *curr && uri && strcmp((*curr)->uri, uri); curr = &(*curr)->next);
+    if(!uri || !*curr)
+        return;
+    doc = *curr;
+    *curr = doc->next;
+
+    /* clear the diagnostics of the closed document */
+    if(start_message(&msg) == SUCCESS)
+    {
+        fputs("\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", msg.fh);
+        write_json_string(msg.fh, doc->uri, strlen(doc->uri));
+        fputs(",\"diagnostics\":[]}", msg.fh);
+        send_message(&msg);
+    }
+    free_document(doc);
+}
+
+/* handle a single request or notification. returns 0 once the client asks us to exit */
+int handle_message(json_value *message)
+{
+    char *method = json_member_string(message, "method");
+    json_value *id = json_member(message, "id"), *params = json_member(message, "params");
+    lsp_message msg;
+
+    if(!method)
+    {
+        if(id)
+            send_error(id, RPC_INVALID_REQUEST, "missing method");
+    }
+    else if(!strcmp(method, "initialize"))
+    {
+        if(start_response(&msg, id) == SUCCESS)
+        {
+            fputs("{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+                  "\"definitionProvider\":true,\"referencesProvider\":true,\"hoverProvider\":true},"
+                  "\"serverInfo\":{\"name\":\"assembler\"}}", msg.fh);
+            send_message(&msg);
+        }
+    }
+    else if(!strcmp(method, "shutdown"))
+    {
+        shutdown_requested = 1;
+        if(start_response(&msg, id) == SUCCESS)
+        {
+            fputs("null", msg.fh);
+            send_message(&msg);
+        }
+    }
+    else if(!strcmp(method, "exit"))
+        return 0;
+    else if(!strcmp(method, "textDocument/didOpen"))
+        handle_did_open(params);
+    else if(!strcmp(method, "textDocument/didChange"))
+        handle_did_change(params);
+    else if(!strcmp(method, "textDocument/didClose"))
+        handle_did_close(params);
+    else if(!strcmp(method, "textDocument/definition"))
+        handle_definition(id, params);
+    else if(!strcmp(method, "textDocument/references"))
+        handle_references(id, params);
+    else if(!strcmp(method, "textDocument/hover"))
+        handle_hover(id, params);
+    else if(id) /* notifications we don't know are ignored */
+        send_error(id, RPC_METHOD_NOT_FOUND, "method not found");
+    return 1;
+}
+
+/* read the next message body. returns NULL at the end of input */
+char *read_message(FILE *fh)
+{
+    char header[LSP_HEADER_MAX];
+    unsigned long len = 0;
+    char *body;
+
+    /* headers end with an empty line, we only need the length */
+    while(fgets(header, sizeof(header), fh) && strcmp(header, "\r\n") && strcmp(header, "\n"))
+    {
+        if(STARTS_WITH(header, "Content-Length:"))
+            len = strtoul(header + strlen("Content-Length:"), NULL, 10);
+    }
+    if(feof(fh) || ferror(fh) || !(body = malloc(len + 1)))
+        return NULL;
+
+    if(fread(body, 1, len, fh) != len)
+    {
+        free(body);
+        return NULL;
+    }
+    body[len] = '\x0';
+    return body;
+}
+
+int main(int argc, char *argv[])
+{
+    char *body;
+    json_value *message;
+    int running = 1;
+    lsp_document *doc;
+
+    while(running && (body = read_message(stdin)))
+    {
+        if((message = parse_json(body)))
+            running = handle_message(message);
+        else
+            send_error(NULL, RPC_PARSE_ERROR, "invalid json");
+        free_json(message);
+        free(body);
+    }
+
+    while((doc = documents))
+    {
+        documents = doc->next;
+        free_document(doc);
+    }
+    return shutdown_requested ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mapped_object.h"
+#include "memory_map.h"
+#include "linked_list.h"
+#include "utilities.h"
+#include "errors.h"
+#include "trace.h"
+#include "alloc_tracking.h"
+
+/*
+ * the object file lines all have the same width, so the offset of every word is known in advance.
+ * the file is created at its final size and mapped, and every thread formats its own range of words
+ * straight into the mapping.
+ */
+
+/* an item of either segment and where its words start in the whole image(code and then data) */
+typedef struct {
+    memory_segment *segment;
+    memory_item *item;
+    unsigned long first_word;
+} image_item;
+
+/* the words [start, end) of the image, formatted by a single thread */
+typedef struct {
+    image_item *items;
+    unsigned int number_of_items;
+    unsigned long start;
+    unsigned long end;
+    char *dst; /* where the line of the first word of the image goes */
+    pthread_t thread;
+} format_job;
+
+/* format a single object file line into dst, no null terminator */
+void format_object_line(char *dst, unsigned long address, unsigned long val)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    int i;
+
+    for(i = 6; i >= 0; i--, address /= 10)
+        dst[i] = '0' + address % 10;
+    dst[7] = ' ';
+    for(i = 13; i >= 8; i--, val >>= 4)
+        dst[i] = hex_digits[val & 0xf];
+    dst[14] = '\n';
+}
+
+/* format the words of a single job */
+void *format_words(void *arg)
+{
+    format_job *job = (format_job *)arg;
+    unsigned int lo = 0, hi = job->number_of_items, mid;
+    unsigned long i;
+    image_item *curr;
+
+    TRACE_BEGIN("format_words", NULL);
+
+    /* find the last item starting at or before our first word */
+    while(hi - lo > 1)
+    {
+        mid = (lo + hi) / 2;
+        if(job->items[mid].first_word <= job->start)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    for(i = job->start, curr = job->items + lo; i < job->end; i++)
+    {
+        while(i >= curr->first_word + curr->item->size_in_words)
+            curr++;
+        format_object_line(job->dst + i * OBJECT_LINE_LEN, calc_absolute_address(curr->segment, curr->item) + (i - curr->first_word),
+                           ITEM_WORD(curr->item, i - curr->first_word));
+    }
+    TRACE_END("format_words");
+    return NULL;
+}
+
+/* add the items of segment to the image. returns the number of words in the image after them */
+unsigned long add_image_items(image_item *items, unsigned int *number_of_items, memory_segment *segment, unsigned long first_word)
+{
+    node *curr;
+    for(curr = segment->items.head; curr; curr = curr->next)
+    {
+        items[*number_of_items].segment = segment;
+        items[*number_of_items].item = (memory_item *)curr->data;
+        items[(*number_of_items)++].first_word = first_word + ((memory_item *)curr->data)->relative_address;
+    }
+    return first_word + size_of_segment(segment);
+}
+
+/* write the object file through a mapping, formatted by number_of_threads threads. returns number of lines written, -1 on failure */
+int write_mapped_object_file(char *file_path, memory_segment *code_segment, memory_segment *data_segment, unsigned int number_of_threads)
+{
+    char name[MAX_FILE_PATH], header[32];
+    unsigned long number_of_words, file_size, i;
+    unsigned int number_of_items = 0;
+    image_item *items;
+    format_job jobs[MAX_WRITER_THREADS];
+    node *curr;
+    char *map;
+    int fd, res = -1;
+
+    /* the words of the code segment come first, then the data right after them */
+    number_of_words = size_of_segment(code_segment) + size_of_segment(data_segment);
+    if(data_segment->base_address + size_of_segment(data_segment) > MAX_FIXED_WIDTH_ADDRESS + 1)
+        return write_object_file(file_path, code_segment, data_segment);
+
+    sprintf(header, "%d %d\n", size_of_segment(code_segment), size_of_segment(data_segment));
+    file_size = strlen(header) + number_of_words * OBJECT_LINE_LEN;
+
+    /* index the items of both segments, so each thread can find where its words start */
+    for(curr = code_segment->items.head; curr; curr = curr->next, number_of_items++);
+    for(curr = data_segment->items.head; curr; curr = curr->next, number_of_items++);
+    if(!(items = malloc((number_of_items + 1) * sizeof(image_item))))
+        return -1;
+    number_of_items = 0;
+    add_image_items(items, &number_of_items, data_segment, add_image_items(items, &number_of_items, code_segment, 0));
+
+    sprintf(name, "%s.ob", file_path);
+    if((fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0)
+    {
+        free(items);
+        return -1;
+    }
+
+    if(ftruncate(fd, file_size) == 0 && (map = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != MAP_FAILED)
+    {
+        memcpy(map, header, strlen(header));
+
+        /* split the words evenly, but don't start threads for just a few of them */
+        if(number_of_threads > MAX_WRITER_THREADS)
+            number_of_threads = MAX_WRITER_THREADS;
+        if(number_of_threads > number_of_words / MIN_WORDS_PER_THREAD)
+            number_of_threads = number_of_words / MIN_WORDS_PER_THREAD ? number_of_words / MIN_WORDS_PER_THREAD : 1;
+
+        for(i = 0; i < number_of_threads; i++)
+        {
+            jobs[i].items = items;
+            jobs[i].number_of_items = number_of_items;
+            jobs[i].start = number_of_words * i / number_of_threads;
+            jobs[i].end = number_of_words * (i + 1) / number_of_threads;
+            jobs[i].dst = map + strlen(header);
+
+            /* the first job is ours, and so is any job a thread couldn't be started for */
+            if(i == 0 || pthread_create(&jobs[i].thread, NULL, format_words, jobs + i) != 0)
+                jobs[i].thread = pthread_self();
+        }
+
+        format_words(jobs);
+        for(i = 1; i < number_of_threads; i++)
+        {
+            if(pthread_equal(jobs[i].thread, pthread_self()))
+                format_words(jobs + i);
+            else
+                pthread_join(jobs[i].thread, NULL);
+        }
+
+        if(munmap(map, file_size) == 0)
+            res = number_of_words;
+    }
+
+    if(close(fd) != 0)
+        res = -1;
+    free(items);
+    return res;
+}
@@ -0,0 +1,20 @@
+#ifndef _MAPPED_OBJECT_H
+#define _MAPPED_OBJECT_H
+
+#include "memory_map.h"
+
+/* every line after the header is "%07u %06x\n" */
+#define OBJECT_LINE_LEN 15
+
+/* largest address with 7 digits, lines of bigger ones are longer and the offsets can't be computed */
+#define MAX_FIXED_WIDTH_ADDRESS 9999999UL
+
+/* most threads formatting a single object file */
+#define MAX_WRITER_THREADS 64
+
+/* fewer words aren't worth a thread of their own */
+#define MIN_WORDS_PER_THREAD 4096
+
+int write_mapped_object_file(char *file_path, memory_segment *code_segment, memory_segment *data_segment, unsigned int number_of_threads);
+
+#endif
@@ -7,6 +7,8 @@
 #include "utilities.h"
 #include "errors.h"
 #include "instructions_table.h"
+#include "archive.h"
+#include "alloc_tracking.h"
 
 memory_item *get_memory_item_by_matching_line_number(memory_segment *segment, unsigned int matching_line_number)
 {
@@ -47,6 +49,9 @@ int add_memory_item(memory_segment *segment, unsigned int size_in_words, word *d
         new_memory_item->size_in_words = size_in_words;
         new_memory_item->data = data;
         new_memory_item->matching_line_number = matching_line_number;
+        new_memory_item->number_of_references = 0;
+        new_memory_item->references = NULL;
+        new_memory_item->is_run = 0;
 
         /* insert to memory items list */
         res = insert(&segment->items, new_memory_item);
@@ -56,12 +61,105 @@ int add_memory_item(memory_segment *segment, unsigned int size_in_words, word *d
     return res;
 }
 
+/* add an item of size_in_words copies of the single word in data, which is kept as is until it's written as text.
+ * returns its absolute address on success, error code otherwise */
+int add_memory_run(memory_segment *segment, unsigned int size_in_words, word *data, unsigned int matching_line_number)
+{
+    int res = add_memory_item(segment, size_in_words, data, matching_line_number);
+    if(res >= 0)
+        ((memory_item *)get_tail(&segment->items))->is_run = 1;
+    return res;
+}
+
+/* attach a copy of the symbols used by the item operands. returns SUCCESS on success, error code otherwise. */
+int set_memory_item_references(memory_item *item, symbol_reference *references, unsigned int number_of_references)
+{
+    if(!number_of_references)
+        return SUCCESS;
+
+    if(!(item->references = malloc(number_of_references * sizeof(symbol_reference))))
+        return ERR_MEM_ALLOC_FAILED;
+    memcpy(item->references, references, number_of_references * sizeof(symbol_reference));
+    item->number_of_references = number_of_references;
+    return SUCCESS;
+}
+
 /* returns the absolute memory address of a given memory item in a given segment */
 unsigned int calc_absolute_address(memory_segment *segment, memory_item *data)
 {
     return segment->base_address + data->relative_address;
 }
 
+/* mark item for removal by compact_memory_segment */
+void mark_memory_item_removed(memory_item *item)
+{
+    free(item->data);
+    item->data = NULL;
+}
+
+/* returns a new array of the relative address of every item of segment followed by the end of the segment(NULL on
+ * failure), and the number of items in number_of_items. tables of the items are indexed like it */
+unsigned int *index_memory_items(memory_segment *segment, unsigned int *number_of_items)
+{
+    node *curr;
+    unsigned int *starts, i = 0;
+
+    for(*number_of_items = 0, curr = segment->items.head; curr; curr = curr->next)
+        (*number_of_items)++;
+    if(!(starts = malloc((*number_of_items + 1) * sizeof(unsigned int))))
+        return NULL;
+    for(curr = segment->items.head; curr; curr = curr->next)
+        starts[i++] = ((memory_item *)curr->data)->relative_address;
+    starts[i] = size_of_segment(segment);
+    return starts;
+}
+
+/* drop the items marked for removal(data freed and set to NULL) and pack the rest. if relocation is given(one entry for
+ * every item of the segment plus one for its end) it's filled with the new relative address of every item, removed
+ * items get the address of the next item left. returns number of words removed */
+unsigned int compact_memory_segment(memory_segment *segment, unsigned int *relocation)
+{
+    node *prev_node = NULL, *curr_node = segment->items.head, *next_node;
+    memory_item *curr_item;
+    unsigned int number_of_items = 0, new_address = 0, removed = 0;
+
+    while(curr_node)
+    {
+        curr_item = (memory_item *)curr_node->data;
+        next_node = curr_node->next;
+
+        if(relocation)
+            relocation[number_of_items++] = new_address;
+
+        if(curr_item->data)
+        {
+            curr_item->relative_address = new_address;
+            new_address += curr_item->size_in_words;
+            prev_node = curr_node;
+        }
+        else
+        {
+            /* unlink and free the item */
+            if(prev_node)
+                prev_node->next = next_node;
+            else
+                segment->items.head = next_node;
+            if(segment->items.tail == curr_node)
+                segment->items.tail = prev_node;
+
+            removed += curr_item->size_in_words;
+            free(curr_item->references);
+            free(curr_item);
+            free(curr_node);
+        }
+        curr_node = next_node;
+    }
+
+    if(relocation)
+        relocation[number_of_items] = new_address;
+    return removed;
+}
+
 /* free a whole memory segment */
 void free_memory_segment(memory_segment *segment)
 {
@@ -72,6 +170,7 @@ void free_memory_segment(memory_segment *segment)
         /* free all the data */
         curr_item = (memory_item *)curr_node->data;
         free(curr_item->data);
+        free(curr_item->references);
         free(curr_item);
 
         /* free the node itself */
@@ -92,7 +191,7 @@ void print_memory_segment(memory_segment *segment)
         curr_item = (memory_item *)curr_node->data;
         for(i = 0; i < curr_item->size_in_words; i++)
         {
-            printf("DEBUG: %07u %06x\n", calc_absolute_address(segment, curr_item) + i, curr_item->data[i].val);
+            printf("DEBUG: %07u %06x\n", calc_absolute_address(segment, curr_item) + i, ITEM_WORD(curr_item, i));
         }
         curr_node = curr_node->next;
     }
@@ -109,7 +208,7 @@ int write_memory_segment(FILE *fh, memory_segment *segment)
         curr_item = (memory_item *)curr_node->data;
         for(j = 0; j < curr_item->size_in_words; j++)
         {
-            fprintf(fh, "%07u %06x\n", calc_absolute_address(segment, curr_item) + j, curr_item->data[j].val);
+            fprintf(fh, "%07u %06x\n", calc_absolute_address(segment, curr_item) + j, ITEM_WORD(curr_item, j));
         }
         curr_node = curr_node->next;
         i += j;
@@ -125,13 +224,14 @@ int write_object_file(char *file_path, memory_segment *code_segment, memory_segm
     int number_of_lines_written = -1;
 
     sprintf((char *)&name, "%s.ob", file_path);
-    fh = fopen(name, "w");
+    fh = open_output_file(name, "w");
     if(fh)
     {
         fprintf(fh, "%d %d\n", size_of_segment(code_segment), size_of_segment(data_segment));
         number_of_lines_written = write_memory_segment(fh, code_segment);
         number_of_lines_written += write_memory_segment(fh, data_segment);
-        fclose(fh);
+        if(close_output_file(fh) != 0)
+            number_of_lines_written = -1;
     }
     return number_of_lines_written;
 }
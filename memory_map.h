@@ -1,26 +1,37 @@
 #ifndef _MEMORY_MAP_H
 #define _MEMORY_MAP_H
 
+#include <stdio.h>
+
 #include "linked_list.h"
+#include "symbols_table.h"
 
-typedef struct {
-    unsigned int E:1;
-    unsigned int R:1;
-    unsigned int A:1;
-    unsigned int funct:5;
-    unsigned int dest_register:3;
-    unsigned int dest_addressing_method:2;
-    unsigned int source_register:3;
-    unsigned int source_addressing_method:2;
-    unsigned int opcode:6;
-} instruction;
+/* ARE flags, the 3 lowest bits of every encoded word */
+#define ARE_E 0x1
+#define ARE_R 0x2
+#define ARE_A 0x4
 
-typedef struct {
-    unsigned int E:1;
-    unsigned int R:1;
-    unsigned int A:1;
-    int val:21;
-} data_word;
+/* bit offsets of the fields of an instruction word */
+#define FUNCT_SHIFT 3
+#define DEST_REG_SHIFT 8
+#define DEST_ADDR_SHIFT 11
+#define SRC_REG_SHIFT 13
+#define SRC_ADDR_SHIFT 16
+#define OPCODE_SHIFT 18
+
+/* operand words keep their 21-bit value right above the ARE flags */
+#define OPERAND_VALUE_SHIFT 3
+
+#define WORD_MASK 0xffffffUL
+
+/* extract a field of given width(in bits) from an encoded word */
+#define WORD_FIELD(val, shift, width) ((unsigned int)(((unsigned long)(val) >> (shift)) & ((1UL << (width)) - 1)))
+#define SRC_ADDR_METHOD(val) WORD_FIELD(val, SRC_ADDR_SHIFT, 2)
+#define DEST_ADDR_METHOD(val) WORD_FIELD(val, DEST_ADDR_SHIFT, 2)
+#define SRC_REG(val) WORD_FIELD(val, SRC_REG_SHIFT, 3)
+#define DEST_REG(val) WORD_FIELD(val, DEST_REG_SHIFT, 3)
+#define OPCODE(val) WORD_FIELD(val, OPCODE_SHIFT, 6)
+#define FUNCT(val) WORD_FIELD(val, FUNCT_SHIFT, 5)
 
 typedef struct {
     unsigned int val:24;
@@ -31,20 +42,42 @@ typedef struct {
     list items;
 } memory_segment;
 
+/* maximum number of symbols a single instruction can use, one per operand */
+#define MAX_REFERENCES 2
+
+/* a symbol used by a direct/relative operand, resolved on the second pass */
+typedef struct {
+    unsigned char word_offset; /* index of the operand word inside the memory item */
+    unsigned char addressing_method;
+    char symbol_name[MAX_LABEL_LEN + 1];
+} symbol_reference;
+
 typedef struct {
     unsigned int relative_address;
     unsigned int size_in_words;
     word *data;
     unsigned int matching_line_number;
+    unsigned int number_of_references;
+    symbol_reference *references;
+    unsigned int is_run:1; /* data is a single word repeated size_in_words times(.space) */
 } memory_item;
 
+/* value of the i-th word of an item, all the words of a run are its single word */
+#define ITEM_WORD(item, i) ((item)->data[(item)->is_run ? 0 : (i)].val)
+
 void init_memory_segment(memory_segment *segment, unsigned int base_address);
 int add_memory_item(memory_segment *segment, unsigned int size_in_words, word *data, unsigned int matching_line_number);
+int add_memory_run(memory_segment *segment, unsigned int size_in_words, word *data, unsigned int matching_line_number);
+int set_memory_item_references(memory_item *item, symbol_reference *references, unsigned int number_of_references);
 memory_item *get_memory_item_by_matching_line_number(memory_segment *segment, unsigned int matching_line_number);
 void print_memory_segment(memory_segment *segment);
 unsigned int size_of_segment(memory_segment *segment);
 unsigned int calc_absolute_address(memory_segment *segment, memory_item *data);
+void mark_memory_item_removed(memory_item *item);
+unsigned int *index_memory_items(memory_segment *segment, unsigned int *number_of_items);
+unsigned int compact_memory_segment(memory_segment *segment, unsigned int *relocation);
 void free_memory_segment(memory_segment *segment);
+int write_memory_segment(FILE *fh, memory_segment *segment);
 int write_object_file(char *file_path, memory_segment *code_segment, memory_segment *data_segment);
 
 #endif
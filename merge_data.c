@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "merge_data.h"
+#include "memory_map.h"
+#include "symbols_table.h"
+#include "alloc_tracking.h"
+
+/*
+ * the data segment is split at its labels into blocks, and a labeled block whose words are all found at the end of another
+ * block is dropped, its label moved to the copy which is kept. identical blocks are always merged, a block ending with a zero
+ * word(a string, or a zero terminated table) is also merged into the tail of a longer one. sorting the blocks by their words
+ * read backwards puts every block right before the blocks it's a suffix of, so each one is only compared with the next.
+ * a block with a .space reservation is storage of its own, it's never merged and its words are never copied.
+ */
+
+/* a run of data items starting at a label(or at the start of the segment) up to the next label */
+typedef struct data_block_ {
+    unsigned int start; /* relative address of the first word */
+    unsigned int size; /* in words */
+    word *end; /* one past its last word, in the copy of the words */
+    unsigned int first_item; /* index of its first item */
+    unsigned int labeled:1;
+    unsigned int reserved:1; /* it has a .space run, it's kept as is */
+    unsigned int merged:1; /* it was dropped, its words are found elsewhere */
+    struct data_block_ *host; /* the block whose words it shares when merged */
+    unsigned int target; /* relative address of its words in the host when merged */
+    unsigned int new_start; /* relative address of the first word once compacted, if it's kept */
+} data_block;
+
+/* compare blocks by their words from the last one backwards, a suffix of another block comes right before it.
+ * of identical blocks the one defined first comes last, so it's the one kept */
+int compare_data_blocks(const void *a, const void *b)
+{
+    data_block *first = *(data_block **)a, *second = *(data_block **)b;
+    unsigned int i, len = first->size < second->size ? first->size : second->size;
+
+    for(i = 1; i <= len; i++)
+    {
+        if(first->end[-(long)i].val != second->end[-(long)i].val)
+            return first->end[-(long)i].val < second->end[-(long)i].val ? -1 : 1;
+    }
+    if(first->size != second->size)
+        return first->size < second->size ? -1 : 1;
+    return first->start > second->start ? -1 : 1;
+}
+
+/* returns non-zero if block can be dropped for the tail of host, which comes right after it in the sorted order */
+int is_suffix_of(data_block *block, data_block *host)
+{
+    unsigned int i;
+
+    if(!block->labeled || block->size > host->size || (block->size < host->size && block->end[-1].val))
+        return 0;
+    for(i = 1; i <= block->size; i++)
+    {
+        if(block->end[-(long)i].val != host->end[-(long)i].val)
+            return 0;
+    }
+    return 1;
+}
+
+/* split the data segment into blocks at its labels(labeled has an entry per item), copying the words of the blocks without
+ * a reservation into words. returns number of blocks */
+unsigned int split_data_blocks(data_block *blocks, word *words, memory_segment *data_segment, char *labeled)
+{
+    node *curr;
+    memory_item *item;
+    data_block *last = NULL;
+    unsigned int number_of_blocks = 0, i, copied = 0;
+
+    for(i = 0, curr = data_segment->items.head; curr; curr = curr->next, i++)
+    {
+        item = (memory_item *)curr->data;
+        if(!last || labeled[i])
+        {
+            last = blocks + number_of_blocks++;
+            last->start = item->relative_address;
+            last->size = 0;
+            last->end = words + copied;
+            last->first_item = i;
+            last->labeled = labeled[i];
+            last->reserved = 0;
+            last->merged = 0;
+        }
+        /* a block with a reservation is never compared, drop the words copied for it */
+        if(item->is_run && !last->reserved)
+        {
+            copied -= last->size;
+            last->reserved = 1;
+        }
+        if(!last->reserved)
+        {
+            memcpy(words + copied, item->data, item->size_in_words * sizeof(word));
+            copied += item->size_in_words;
+            last->end = words + copied;
+        }
+        last->size += item->size_in_words;
+    }
+    return number_of_blocks;
+}
+
+/* merge the labeled data blocks whose words can be shared with another block, and move their labels to the shared copy.
+ * must run after the first pass and before data symbols get their final address. returns number of words removed */
+unsigned int merge_data_segment(memory_segment *data_segment, symbol_table *symbols)
+{
+    unsigned int number_of_items, number_of_blocks, number_sorted = 0, number_of_words = 0, i, k, new_address = 0, removed = 0;
+    unsigned int *starts, *relocation;
+    data_block *blocks, **order, *block;
+    word *words;
+    char *labeled;
+    node *curr;
+
+    /* only the words which are stored one by one are copied */
+    for(curr = data_segment->items.head; curr; curr = curr->next)
+        number_of_words += ((memory_item *)curr->data)->is_run ? 0 : ((memory_item *)curr->data)->size_in_words;
+
+    starts = index_memory_items(data_segment, &number_of_items);
+    blocks = malloc((number_of_items + 1) * sizeof(data_block)); /* never more blocks than items */
+    order = malloc((number_of_items + 1) * sizeof(data_block *));
+    relocation = malloc((number_of_items + 1) * sizeof(unsigned int));
+    words = malloc((number_of_words + 1) * sizeof(word));
+    labeled = malloc(number_of_items + 1);
+
+    if(starts && blocks && order && relocation && words && labeled && number_of_items)
+    {
+        mark_symbols_items(labeled, symbols, data, data_segment->base_address, starts, number_of_items);
+        number_of_blocks = split_data_blocks(blocks, words, data_segment, labeled);
+        for(i = 0; i < number_of_blocks; i++)
+        {
+            if(!blocks[i].reserved)
+                order[number_sorted++] = blocks + i;
+        }
+        qsort(order, number_sorted, sizeof(data_block *), compare_data_blocks);
+
+        /* the kept copy is found from the end, a block sharing the words of a merged one shares the words it was merged into */
+        for(i = number_sorted ? number_sorted - 1 : 0; i-- > 0; )
+        {
+            if(!is_suffix_of(order[i], order[i + 1]))
+                continue;
+            order[i]->merged = 1;
+            order[i]->host = order[i + 1]->merged ? order[i + 1]->host : order[i + 1];
+            order[i]->target = order[i + 1]->merged ? order[i + 1]->target + order[i + 1]->size - order[i]->size :
+                               order[i + 1]->start + order[i + 1]->size - order[i]->size;
+        }
+
+        /* the words of the kept blocks move back over the merged ones */
+        for(i = 0; i < number_of_blocks; i++)
+        {
+            blocks[i].new_start = new_address;
+            new_address += blocks[i].merged ? 0 : blocks[i].size;
+        }
+
+        /* every item moves with its block, the items of a merged block to where its words are kept */
+        for(block = blocks, k = 0, curr = data_segment->items.head; curr; curr = curr->next, k++)
+        {
+            if(block + 1 < blocks + number_of_blocks && block[1].first_item == k)
+                block++;
+            relocation[k] = starts[k] - block->start +
+                            (block->merged ? block->host->new_start + block->target - block->host->start : block->new_start);
+            if(block->merged)
+                mark_memory_item_removed((memory_item *)curr->data);
+        }
+        relocation[number_of_items] = new_address;
+
+        if((removed = compact_memory_segment(data_segment, NULL)))
+            relocate_symbols(symbols, data, data_segment->base_address, starts, number_of_items, relocation);
+    }
+
+    free(starts);
+    free(blocks);
+    free(order);
+    free(relocation);
+    free(words);
+    free(labeled);
+    return removed;
+}
@@ -0,0 +1,9 @@
+#ifndef _MERGE_DATA_H
+#define _MERGE_DATA_H
+
+#include "memory_map.h"
+#include "symbols_table.h"
+
+unsigned int merge_data_segment(memory_segment *data_segment, symbol_table *symbols);
+
+#endif
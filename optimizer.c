@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "optimizer.h"
+#include "memory_map.h"
+#include "symbols_table.h"
+#include "instructions_table.h"
+#include "utilities.h"
+#include "alloc_tracking.h"
+
+/* ids of the instructions the optimizer knows about */
+typedef struct {
+    int mov;
+    int jmp;
+    int inc;
+    int dec;
+} known_instructions;
+
+/* returns non-zero for "mov rX, rX" */
+int is_self_move(known_instructions *ids, memory_item *item)
+{
+    unsigned long val = item->data->val;
+    return decode_instruction_id(val) == ids->mov && SRC_ADDR_METHOD(val) == ADDR_REG_DIRECT &&
+           DEST_ADDR_METHOD(val) == ADDR_REG_DIRECT && SRC_REG(val) == DEST_REG(val);
+}
+
+/* returns non-zero for a jmp to the instruction right after it */
+int is_jump_to_next(known_instructions *ids, memory_segment *code_segment, memory_item *item, symbol_table *symbols)
+{
+    symbol_entry *target;
+
+    if(decode_instruction_id(item->data->val) != ids->jmp || item->number_of_references != 1)
+        return 0;
+
+    /* the code segment base is final, so are code symbols addresses */
+    target = resolve_symbol(symbols, item->references[0].symbol_name);
+    return target && target->type == code && symbol_address(symbols, target) == calc_absolute_address(code_segment, item) + item->size_in_words;
+}
+
+/* returns non-zero if both items are "inc X" and "dec X"(in any order) of the very same operand */
+int is_inc_dec_pair(known_instructions *ids, memory_item *first, memory_item *second)
+{
+    int first_id = decode_instruction_id(first->data->val), second_id = decode_instruction_id(second->data->val);
+    unsigned long first_val = first->data->val, second_val = second->data->val;
+
+    if(!((first_id == ids->inc && second_id == ids->dec) || (first_id == ids->dec && second_id == ids->inc)))
+        return 0;
+    if(DEST_ADDR_METHOD(first_val) != DEST_ADDR_METHOD(second_val))
+        return 0;
+    if(DEST_ADDR_METHOD(first_val) == ADDR_REG_DIRECT)
+        return DEST_REG(first_val) == DEST_REG(second_val);
+    return first->number_of_references == 1 && second->number_of_references == 1 &&
+           !strcmp(first->references[0].symbol_name, second->references[0].symbol_name);
+}
+
+/* run all patterns once over the code segment, marking the items to remove. labeled has an entry for every item.
+ * returns number of items marked */
+unsigned int mark_redundant_items(known_instructions *ids, memory_segment *code_segment, symbol_table *symbols, char *labeled)
+{
+    node *curr_node;
+    memory_item *curr, *next;
+    unsigned int i, marked = 0;
+
+    for(i = 0, curr_node = code_segment->items.head; curr_node; curr_node = curr_node->next, i++)
+    {
+        curr = (memory_item *)curr_node->data;
+        next = curr_node->next ? (memory_item *)curr_node->next->data : NULL;
+        if(!curr->data)
+            continue; /* already removed as part of a pair */
+
+        if(is_self_move(ids, curr) || is_jump_to_next(ids, code_segment, curr, symbols))
+        {
+            mark_memory_item_removed(curr);
+            marked++;
+        }
+        else if(next && !labeled[i + 1] && is_inc_dec_pair(ids, curr, next))
+        {
+            mark_memory_item_removed(curr);
+            mark_memory_item_removed(next);
+            marked += 2;
+        }
+    }
+    return marked;
+}
+
+/* remove redundant instructions from a code segment which was not resolved yet, and move the code labels accordingly.
+ * removing an instruction might expose a new pattern(e.g. jump over a removed instruction) so run until nothing changes.
+ * returns number of words removed */
+unsigned int optimize_code_segment(memory_segment *code_segment, symbol_table *symbols)
+{
+    known_instructions ids;
+    unsigned int *starts, *relocation, number_of_items;
+    char *labeled;
+    unsigned int removed, total = 0;
+
+    ids.mov = get_instruction_id("mov");
+    ids.jmp = get_instruction_id("jmp");
+    ids.inc = get_instruction_id("inc");
+    ids.dec = get_instruction_id("dec");
+
+    do
+    {
+        starts = index_memory_items(code_segment, &number_of_items);
+        relocation = malloc((number_of_items + 1) * sizeof(unsigned int));
+        labeled = malloc(number_of_items + 1);
+        removed = 0;
+
+        if(starts && relocation && labeled)
+        {
+            /* don't remove an instruction someone might jump to in the middle of a pattern */
+            mark_symbols_items(labeled, symbols, code, code_segment->base_address, starts, number_of_items);
+            if(mark_redundant_items(&ids, code_segment, symbols, labeled))
+            {
+                removed = compact_memory_segment(code_segment, relocation);
+                relocate_symbols(symbols, code, code_segment->base_address, starts, number_of_items, relocation);
+                total += removed;
+            }
+        }
+
+        free(starts);
+        free(relocation);
+        free(labeled);
+    } while(removed);
+
+    return total;
+}
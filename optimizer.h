@@ -0,0 +1,9 @@
+#ifndef _OPTIMIZER_H
+#define _OPTIMIZER_H
+
+#include "memory_map.h"
+#include "symbols_table.h"
+
+unsigned int optimize_code_segment(memory_segment *code_segment, symbol_table *symbols);
+
+#endif
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "options.h"
+#include "utilities.h"
+#include "errors.h"
+#include "mapped_object.h"
+
+/* options used by all the assembler modules, set once by parse_options */
+assembler_options options = {1, 0, 0, 0, 0, NULL, 0, 0, NULL, NULL, 0, NULL, -1, 0, 0, 0, NULL, 0, 0, NULL, NULL, NULL, 0};
+
+/* handle a single option. returns SUCCESS on success, error code otherwise. */
+int parse_option(char *option)
+{
+    int res = ERR_INVALID_OPTION;
+    char *sep, *end;
+    long value;
+
+    if(!strcmp(option, "watch"))
+    {
+        options.watch = 1;
+        res = SUCCESS;
+    }
+    else if(!strcmp(option, "incremental"))
+    {
+        options.incremental = 1;
+        res = SUCCESS;
+    }
+    else if(!strcmp(option, "optimize"))
+    {
+        options.optimize = 1;
+        res = SUCCESS;
+    }
+    else if(!strcmp(option, "gc-sections"))
+    {
+        options.gc_sections = 1;
+        res = SUCCESS;
+    }
+    else if(STARTS_WITH(option, "gc-start="))
+    {
+        options.gc_start_label = option + strlen("gc-start=");
+        res = is_valid_label(options.gc_start_label) == OK ? SUCCESS : ERR_INVALID_LABEL;
+    }
+    else if(!strcmp(option, "merge-data"))
+    {
+        options.merge_data = 1;
+        res = SUCCESS;
+    }
+    else if(!strcmp(option, "xref"))
+    {
+        options.xref = 1;
+        res = SUCCESS;
+    }
+    else if(STARTS_WITH(option, "dump-xref=") && option[strlen("dump-xref=")])
+    {
+        /* the symbol, if given, follows the last comma */
+        options.dump_xref_path = option + strlen("dump-xref=");
+        if((options.dump_xref_symbol = strrchr(options.dump_xref_path, ',')))
+            *options.dump_xref_symbol++ = '\x0';
+        res = SUCCESS;
+    }
+    else if(!strcmp(option, "compress"))
+    {
+        options.compress = 1;
+        res = SUCCESS;
+    }
+    else if(STARTS_WITH(option, "decompress=") && option[strlen("decompress=")])
+    {
+        /* the address, if given, follows the last comma */
+        options.decompress_path = option + strlen("decompress=");
+        res = SUCCESS;
+        if((sep = strrchr(options.decompress_path, ',')))
+        {
+            *sep++ = '\x0';
+            options.decompress_address = strtol(sep, &end, 10);
+            if(!*sep || *end || options.decompress_address < 0)
+                res = ERR_INVALID_VALUE;
+        }
+    }
+    else if(!strcmp(option, "low-memory"))
+    {
+        options.low_memory = 1;
+        res = SUCCESS;
+    }
+    else if(!strcmp(option, "pipeline"))
+    {
+        options.pipeline = 1;
+        res = SUCCESS;
+    }
+    else if(!strcmp(option, "check"))
+    {
+        options.check = 1;
+        res = SUCCESS;
+    }
+    else if(!strcmp(option, "stats"))
+    {
+        options.stats = 1;
+        res = SUCCESS;
+    }
+    else if(!strcmp(option, "relocations"))
+    {
+        options.relocations = 1;
+        res = SUCCESS;
+    }
+    else if(STARTS_WITH(option, "disassemble=") && option[strlen("disassemble=")])
+    {
+        options.disassemble_path = option + strlen("disassemble=");
+        res = SUCCESS;
+    }
+    else if(STARTS_WITH(option, "archive=") && option[strlen("archive=")])
+    {
+        /* the output archive follows the last comma */
+        options.archive_path = option + strlen("archive=");
+        res = ERR_MISSING_VALUE;
+        if((options.archive_output_path = strrchr(options.archive_path, ',')))
+        {
+            *options.archive_output_path++ = '\x0';
+            res = *options.archive_path && *options.archive_output_path && strcmp(options.archive_path, options.archive_output_path) ?
+                  SUCCESS : ERR_INVALID_VALUE;
+        }
+    }
+    else if(STARTS_WITH(option, "trace=") && option[strlen("trace=")])
+    {
+        options.trace_path = option + strlen("trace=");
+        res = SUCCESS;
+    }
+    else if(STARTS_WITH(option, "threads=") && option[strlen("threads=")])
+    {
+        option += strlen("threads=");
+        value = strtol(option, &end, 10);
+        if(!*end && value > 0 && value <= MAX_WRITER_THREADS)
+        {
+            options.threads = value;
+            res = SUCCESS;
+        }
+        else
+        {
+            res = ERR_INVALID_VALUE;
+        }
+    }
+    else if(STARTS_WITH(option, "incbin-pack="))
+    {
+        option += strlen("incbin-pack=");
+        if(!strcmp(option, "1") || !strcmp(option, "3"))
+        {
+            options.incbin_bytes_per_word = *option - '0';
+            res = SUCCESS;
+        }
+    }
+    return res;
+}
+
+/* parse the command line, saves all the files to assemble in files. returns number of files on success, error code otherwise. */
+int parse_options(int argc, char *argv[], char **files)
+{
+    int i, res, number_of_files = 0;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(STARTS_WITH(argv[i], OPTION_PREFIX))
+        {
+            if((res = parse_option(argv[i] + strlen(OPTION_PREFIX))) != SUCCESS)
+            {
+                printf("ERROR! %s \"%s\"\n", error_code_to_string(res), argv[i]);
+                return res;
+            }
+        }
+        else
+        {
+            files[number_of_files++] = argv[i];
+        }
+    }
+
+    /* the incremental state refers to the lines as written, the optimizer, gc and data merging might remove some of them */
+    if(options.incremental && (options.optimize || options.gc_sections || options.merge_data))
+    {
+        printf("ERROR! %s \"%sincremental\" can't be used with \"%s%s\"\n", error_code_to_string(ERR_INVALID_OPTION),
+               OPTION_PREFIX, OPTION_PREFIX, options.optimize ? "optimize" : options.gc_sections ? "gc-sections" : "merge-data");
+        return ERR_INVALID_OPTION;
+    }
+
+    /* streaming never holds the whole program, which all of these need */
+    if(options.low_memory && (options.incremental || options.optimize || options.gc_sections || options.merge_data || options.compress ||
+       options.relocations))
+    {
+        printf("ERROR! %s \"%slow-memory\" can't be used with \"%s%s\"\n", error_code_to_string(ERR_INVALID_OPTION), OPTION_PREFIX, OPTION_PREFIX,
+               options.incremental ? "incremental" : options.optimize ? "optimize" : options.gc_sections ? "gc-sections" :
+               options.merge_data ? "merge-data" : options.compress ? "compress" : "relocations");
+        return ERR_INVALID_OPTION;
+    }
+
+    /* the threads format the plain text object file only */
+    if(options.threads && (options.low_memory || options.compress))
+    {
+        printf("ERROR! %s \"%sthreads\" can't be used with \"%s%s\"\n", error_code_to_string(ERR_INVALID_OPTION), OPTION_PREFIX, OPTION_PREFIX,
+               options.low_memory ? "low-memory" : "compress");
+        return ERR_INVALID_OPTION;
+    }
+
+    /* the output archive is written one file at a time from memory, by the assembler thread */
+    if(options.archive_path && (options.pipeline || options.threads || options.incremental || options.compress || options.relocations || options.xref))
+    {
+        printf("ERROR! %s \"%sarchive\" can't be used with \"%s%s\"\n", error_code_to_string(ERR_INVALID_OPTION), OPTION_PREFIX, OPTION_PREFIX,
+               options.pipeline ? "pipeline" : options.threads ? "threads" : options.incremental ? "incremental" :
+               options.compress ? "compress" : options.relocations ? "relocations" : "xref");
+        return ERR_INVALID_OPTION;
+    }
+    return number_of_files;
+}
@@ -0,0 +1,37 @@
+#ifndef _OPTIONS_H
+#define _OPTIONS_H
+
+/* command line options prefix */
+#define OPTION_PREFIX "--"
+
+typedef struct {
+    unsigned int incbin_bytes_per_word; /* how many bytes of an .incbin file are packed into each word(1 or 3) */
+    unsigned int watch:1; /* keep running and reassemble files when they change */
+    unsigned int incremental:1; /* reuse the encoding of unchanged lines from the previous run */
+    unsigned int optimize:1; /* run the peephole optimizer over the code segment */
+    unsigned int gc_sections:1; /* drop code and data which can't be reached */
+    char *gc_start_label; /* where execution starts, NULL for the start of the code */
+    unsigned int merge_data:1; /* share the words of labeled data blocks which are identical, or the tail of another block */
+    unsigned int xref:1; /* write the cross reference index of the symbols */
+    char *dump_xref_path; /* cross reference index file to print, NULL for none */
+    char *dump_xref_symbol; /* the only symbol to print from it, NULL for all */
+    unsigned int compress:1; /* write the object file compressed(.obz) instead of as text */
+    char *decompress_path; /* compressed object file to print as text, NULL for none */
+    long decompress_address; /* the only address to print from it, -1 for all */
+    unsigned int low_memory:1; /* stream the encoded words to disk instead of keeping them */
+    unsigned int pipeline:1; /* read the next sources and write the outputs in the background */
+    unsigned int check:1; /* only look for errors, nothing is encoded or written */
+    char *trace_path; /* chrome trace event file to record the timeline of the run into, NULL for none */
+    unsigned int stats:1; /* print how well the encoding cache did on each file */
+    unsigned int relocations:1; /* write the addresses of the words which move with the image */
+    char *disassemble_path; /* object file(without the .ob) to print as source text, NULL for none */
+    char *archive_path; /* tar archive of sources to assemble, NULL for none */
+    char *archive_output_path; /* tar archive all the output files are written to, when assembling an archive */
+    unsigned int threads; /* format the object file with this many threads through a mapping, 0 to write it with stdio */
+} assembler_options;
+
+extern assembler_options options;
+
+int parse_options(int argc, char *argv[], char **files);
+
+#endif
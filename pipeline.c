@@ -0,0 +1,286 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+#include "utilities.h"
+#include "trace.h"
+#include "alloc_tracking.h"
+
+/*
+ * while a file is assembled, a reader thread reads the next sources into memory and a writer thread
+ * writes the output files of the previous ones. when the pipeline isn't running all of these
+ * fall back to plain(synchronous) file access, so callers don't need to care.
+ */
+
+typedef struct {
+    char name[MAX_FILE_PATH]; /* source file name, with the .as extension */
+    char *text; /* the whole file, NULL if it couldn't be read */
+    size_t size;
+} prefetched_source;
+
+typedef struct output_job_ {
+    void (*write)(void *);
+    void *data;
+    struct output_job_ *next;
+} output_job;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed; /* signaled on every change, both threads and the assembler wait on it */
+    pthread_t reader;
+    pthread_t writer;
+    unsigned int running:1; /* the flags are only used by the assembler thread */
+    unsigned int writer_started:1;
+    int stopping; /* not a bit field, the threads read it while the flags are set */
+
+    char **files;
+    int number_of_files;
+    prefetched_source *sources;
+    int number_of_read; /* sources read by the reader */
+    int number_of_opened; /* sources taken by the assembler */
+    char *open_text; /* text of the source being assembled */
+
+    output_job *first_job;
+    output_job *last_job;
+    int number_of_jobs;
+} pipeline_state;
+
+pipeline_state pipeline;
+
+/* ask the kernel to start reading a file we'll need soon */
+void advise_will_need(char *file_path)
+{
+    char name[MAX_FILE_PATH];
+    int fd;
+
+    sprintf(name, "%s.as", file_path);
+    if((fd = open(name, O_RDONLY)) >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+}
+
+/* read the whole source into memory, leaving text NULL on failure */
+void read_source(prefetched_source *source)
+{
+    FILE *fh;
+    long size;
+
+    source->text = NULL;
+    if(!(fh = fopen(source->name, "r")))
+        return;
+
+    posix_fadvise(fileno(fh), 0, 0, POSIX_FADV_SEQUENTIAL);
+    if(!fseek(fh, 0, SEEK_END) && (size = ftell(fh)) >= 0 && !fseek(fh, 0, SEEK_SET) && (source->text = malloc(size + 1)))
+    {
+        if((source->size = fread(source->text, 1, size, fh)) != (size_t)size)
+        {
+            free(source->text);
+            source->text = NULL;
+        }
+    }
+    fclose(fh);
+}
+
+/* read the sources in order, staying at most PIPELINE_DEPTH ahead of the assembler */
+void *reader_thread(void *arg)
+{
+    int i;
+
+    trace_thread_name("reader");
+    pthread_mutex_lock(&pipeline.lock);
+    while(pipeline.number_of_read < pipeline.number_of_files && !pipeline.stopping)
+    {
+        if(pipeline.number_of_read - pipeline.number_of_opened >= PIPELINE_DEPTH)
+        {
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+            continue;
+        }
+        i = pipeline.number_of_read;
+        pthread_mutex_unlock(&pipeline.lock);
+
+        if(i + 1 < pipeline.number_of_files)
+            advise_will_need(pipeline.files[i + 1]);
+        TRACE_BEGIN("read_source", pipeline.sources[i].name);
+        read_source(pipeline.sources + i);
+        TRACE_END("read_source");
+
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.number_of_read++;
+        pthread_cond_broadcast(&pipeline.changed);
+    }
+    pthread_mutex_unlock(&pipeline.lock);
+    return arg;
+}
+
+/* run the queued jobs in order until stopped and nothing is left */
+void *writer_thread(void *arg)
+{
+    output_job *job;
+
+    trace_thread_name("writer");
+    pthread_mutex_lock(&pipeline.lock);
+    while(pipeline.first_job || !pipeline.stopping)
+    {
+        if(!(job = pipeline.first_job))
+        {
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+            continue;
+        }
+        if(!(pipeline.first_job = job->next))
+            pipeline.last_job = NULL;
+        pthread_mutex_unlock(&pipeline.lock);
+
+        job->write(job->data);
+        free(job);
+
+        pthread_mutex_lock(&pipeline.lock);
+        pipeline.number_of_jobs--;
+        pthread_cond_broadcast(&pipeline.changed);
+    }
+    pthread_mutex_unlock(&pipeline.lock);
+    return arg;
+}
+
+/* start reading files(given without extension) ahead and writing outputs in the background */
+void start_pipeline(char **files, int number_of_files)
+{
+    int i;
+
+    memset(&pipeline, 0, sizeof(pipeline));
+    if(number_of_files <= 0 || !(pipeline.sources = malloc(number_of_files * sizeof(prefetched_source))))
+        return;
+
+    for(i = 0; i < number_of_files; i++)
+    {
+        /* too long names are refused by the assembler anyway */
+        *pipeline.sources[i].name = '\x0';
+        if(strlen(files[i]) < MAX_FILE_PATH - 5)
+            sprintf(pipeline.sources[i].name, "%s.as", files[i]);
+    }
+    pipeline.files = files;
+    pipeline.number_of_files = number_of_files;
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+
+    if(pthread_create(&pipeline.reader, NULL, reader_thread, NULL))
+    {
+        free(pipeline.sources);
+        pipeline.sources = NULL;
+        return;
+    }
+    /* without a writer the outputs are simply written right away */
+    pipeline.writer_started = !pthread_create(&pipeline.writer, NULL, writer_thread, NULL);
+    pipeline.running = 1;
+}
+
+/* finish writing all the queued outputs and stop the threads */
+void stop_pipeline(void)
+{
+    int i;
+
+    if(!pipeline.running)
+        return;
+
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.stopping = 1;
+    pthread_cond_broadcast(&pipeline.changed);
+    pthread_mutex_unlock(&pipeline.lock);
+    pthread_join(pipeline.reader, NULL);
+    if(pipeline.writer_started)
+        pthread_join(pipeline.writer, NULL);
+
+    /* sources read but never assembled */
+    for(i = pipeline.number_of_opened; i < pipeline.number_of_read; i++)
+        free(pipeline.sources[i].text);
+    free(pipeline.sources);
+    pthread_cond_destroy(&pipeline.changed);
+    pthread_mutex_destroy(&pipeline.lock);
+    pipeline.running = 0;
+}
+
+/* open source file for reading, from memory if it was read ahead. returns NULL on failure */
+FILE *pipeline_open_source(char *filename)
+{
+    prefetched_source *source = NULL;
+    FILE *fh;
+
+    if(!pipeline.running)
+        return fopen(filename, "r");
+
+    /* sources come in the order they're assembled, skip those the assembler didn't ask for */
+    pthread_mutex_lock(&pipeline.lock);
+    while(!source && pipeline.number_of_opened < pipeline.number_of_files)
+    {
+        if(pipeline.number_of_opened == pipeline.number_of_read)
+        {
+            pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+            continue;
+        }
+        source = pipeline.sources + pipeline.number_of_opened++;
+        if(strcmp(source->name, filename))
+        {
+            free(source->text);
+            source = NULL;
+        }
+        pthread_cond_broadcast(&pipeline.changed);
+    }
+    pthread_mutex_unlock(&pipeline.lock);
+
+    if(!source)
+        return fopen(filename, "r");
+    if(!source->text)
+        return NULL;
+
+    /* an empty buffer can't be opened as a stream, read it from disk instead */
+    if(!source->size || !(fh = fmemopen(source->text, source->size, "r")))
+    {
+        free(source->text);
+        return fopen(filename, "r");
+    }
+    pipeline.open_text = source->text;
+    return fh;
+}
+
+/* close source opened by pipeline_open_source */
+void pipeline_close_source(FILE *fh)
+{
+    fclose(fh);
+    free(pipeline.open_text);
+    pipeline.open_text = NULL;
+}
+
+/* call write(data) on the writer thread, or right away if the pipeline isn't running */
+void pipeline_write(void (*write)(void *), void *data)
+{
+    output_job *job;
+
+    if(!pipeline.running || !pipeline.writer_started || !(job = malloc(sizeof(output_job))))
+    {
+        write(data);
+        return;
+    }
+    job->write = write;
+    job->data = data;
+    job->next = NULL;
+
+    /* don't let assembled files pile up in memory if the disk is slow */
+    pthread_mutex_lock(&pipeline.lock);
+    while(pipeline.number_of_jobs >= PIPELINE_DEPTH)
+        pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+    if(pipeline.last_job)
+        pipeline.last_job->next = job;
+    else
+        pipeline.first_job = job;
+    pipeline.last_job = job;
+    pipeline.number_of_jobs++;
+    pthread_cond_broadcast(&pipeline.changed);
+    pthread_mutex_unlock(&pipeline.lock);
+}
@@ -0,0 +1,15 @@
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include <stdio.h>
+
+/* how many sources may be read ahead, and how many files may wait to be written */
+#define PIPELINE_DEPTH 2
+
+void start_pipeline(char **files, int number_of_files);
+void stop_pipeline(void);
+FILE *pipeline_open_source(char *filename);
+void pipeline_close_source(FILE *fh);
+void pipeline_write(void (*write)(void *), void *data);
+
+#endif
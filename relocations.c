@@ -0,0 +1,63 @@
+#include <stdio.h>
+
+#include "relocations.h"
+#include "compressed_object.h"
+#include "linked_list.h"
+#include "utilities.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/*
+ * the relocations file lists every word holding the address of a code or data symbol(the R words),
+ * so a loader can move the image by patching only them. it's binary:
+ * magic, number of relocations, base address of the code & data segments, then a varint per word,
+ * in address order: the distance from the previous word(from 0 for the first one) << 1 | segment tag.
+ * the tag tells which segment the address in the word points into.
+ */
+
+/* write the relocations of the code segment to file. returns number of relocations written, -1 on failure */
+int write_relocations_file(char *file_path, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols)
+{
+    char name[MAX_FILE_PATH];
+    FILE *fh;
+    unsigned long number_of_relocations = 0, address, prev = 0;
+    unsigned int i;
+    node *curr;
+    memory_item *item;
+    symbol_entry *symbol;
+    int res;
+
+    sprintf(name, "%s.rel", file_path);
+    if(!(fh = fopen(name, "wb")))
+        return -1;
+
+    /* the number of relocations is filled in at the end */
+    write_u32(fh, REL_FILE_MAGIC);
+    write_u32(fh, 0);
+    write_u32(fh, code_segment->base_address);
+    write_u32(fh, data_segment->base_address);
+
+    /* the items and the references of each are both in address order */
+    for(curr = code_segment->items.head; curr; curr = curr->next)
+    {
+        item = (memory_item *)curr->data;
+        for(i = 0; i < item->number_of_references; i++)
+        {
+            /* relative operands and externals don't move with the image */
+            if(item->references[i].addressing_method != ADDR_DIRECT || !(symbol = resolve_symbol(symbols, item->references[i].symbol_name)) ||
+               symbol->type == external)
+                continue;
+
+            address = calc_absolute_address(code_segment, item) + item->references[i].word_offset;
+            write_varint(fh, (address - prev) << 1 | (symbol->type == data ? REL_TAG_DATA : REL_TAG_CODE));
+            prev = address;
+            number_of_relocations++;
+        }
+    }
+
+    if((res = fseek(fh, 4, SEEK_SET) == 0 ? (int)number_of_relocations : -1) >= 0)
+        write_u32(fh, number_of_relocations);
+    if(fclose(fh) != 0)
+        res = -1;
+    return res;
+}
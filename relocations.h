@@ -0,0 +1,16 @@
+#ifndef _RELOCATIONS_H
+#define _RELOCATIONS_H
+
+#include "memory_map.h"
+#include "symbols_table.h"
+
+/* magic number at the start of the relocations file("REL1") */
+#define REL_FILE_MAGIC 0x314c4552UL
+
+/* segment tag of a relocation, which base its word has to be moved by */
+#define REL_TAG_CODE 0
+#define REL_TAG_DATA 1
+
+int write_relocations_file(char *file_path, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols);
+
+#endif
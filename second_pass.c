@@ -9,82 +9,44 @@
 #include "memory_map.h"
 #include "errors.h"
 #include "externals.h"
-
-/* check if operand requires an update by its addressing method. use macro to avoid extra function call. */
-#define REQUIRES_UPDATE(addressing_method) (addressing_method == ADDR_DIRECT || addressing_method == ADDR_RELATIVE)
-
+#include "second_pass.h"
+#include "options.h"
+#include "alloc_tracking.h"
 
 /* complete the encoding of instructions which depended on symbols/labels */
-int complete_instruction_encoding(char *line, memory_segment *code_segment, memory_item *curr, symbol_table *symbols, externals_table *external_symbols)
+int complete_instruction_encoding(memory_segment *code_segment, memory_item *curr, symbol_table *symbols, externals_table *external_symbols)
 {
     int res = SUCCESS;
-    char operand1[LINE_MAX], operand2[LINE_MAX];
+    unsigned int i;
     symbol_entry *symbol;
-    char *symbol_name;
-    int number_of_operands;
-    instruction *inst = (instruction *)curr->data;
-    data_word *operands = curr->size_in_words > 1 ? (data_word *)(inst + 1) : NULL;
-
-    /* read the operands */
-    number_of_operands = split_operands(skip_word(line), operand1, operand2);
+    symbol_reference *reference;
 
-    /* update the source operand if required */
-    if(number_of_operands == 2 && REQUIRES_UPDATE(inst->source_addressing_method))
+    /* resolve the symbols the first pass saved for us, in the order of the operands */
+    for(i = 0; i < curr->number_of_references && res == SUCCESS; i++)
     {
-        /* read the symbol name string */
-        symbol_name = skip_whitespaces(operand1);
-        if(inst->source_addressing_method == ADDR_RELATIVE)
-            symbol_name++;
-
-        /* resolve symbol */
-        if ((symbol = resolve_symbol(symbols, symbol_name)))
+        reference = curr->references + i;
+        if((symbol = resolve_symbol(symbols, reference->symbol_name)))
         {
             /* encode symbol address according to the operands addressing method */
-            if(inst->source_addressing_method == ADDR_DIRECT)
-                encode_direct(operands, symbol);
+            if(reference->addressing_method == ADDR_DIRECT)
+                encode_direct(curr->data + reference->word_offset, symbol, symbol_address(symbols, symbol));
             else
-                encode_relative(operands, symbol, calc_absolute_address(code_segment, curr));
-            operands++;
+                encode_relative(curr->data + reference->word_offset, symbol_address(symbols, symbol), calc_absolute_address(code_segment, curr));
 
             /* save external symbols to externals table */
             if(symbol->type == external)
-                add_external_item(external_symbols, symbol->name, calc_absolute_address(code_segment, curr) + 1);
-        }
-        else
-        {
-            res = ERR_MISSING_SYMBOL;
-        }
-    }
+                add_external_item(external_symbols, symbol->name, calc_absolute_address(code_segment, curr) + reference->word_offset);
 
-    /* update the destination operand if required */
-    if(number_of_operands >= 1 && res != ERR_MISSING_SYMBOL && REQUIRES_UPDATE(inst->dest_addressing_method))
-    {
-        /* read the symbol name string */
-        symbol_name = skip_whitespaces(number_of_operands == 2 ? operand2 : operand1);
-        if(inst->dest_addressing_method == ADDR_RELATIVE)
-            symbol_name++; /* skip '&' char */
-
-        /* resolve symbol */
-        if((symbol = resolve_symbol(symbols, symbol_name)))
-        {
-            /* encode symbol address according to the operands addressing method */
-            if(inst->dest_addressing_method == ADDR_DIRECT)
-                encode_direct(operands, symbol);
-            else
-                encode_relative(operands, symbol, calc_absolute_address(code_segment, curr));
-
-            /* save external symbols to externals table */
-            if(symbol->type == external)
-                add_external_item(external_symbols, symbol->name, calc_absolute_address(code_segment, curr) + number_of_operands);
+            /* keep this usage for the cross reference index */
+            if(options.xref)
+                add_symbol_usage(symbol, curr->matching_line_number, reference->addressing_method);
         }
         else
         {
             res = ERR_MISSING_SYMBOL;
         }
     }
-
-    /* we might have invalid operands if so return the error code */
-    return number_of_operands >= 1 ? res : number_of_operands;
+    return res;
 }
 
 /* update a symbol to entry type */
@@ -96,15 +58,14 @@ int update_entry(symbol_table *symbols, char *line)
     start = skip_whitespaces(line + 6); /* skip '.entry' word and extra whitespaces */
 
     /* remove extra whitespaces after the label */
-    for(end = start + 1; *end && !isspace(*end); end++);
+    for(end = start; *end && !isspace(*end); end++);
     *end = '\x0';
 
-    /* find the symbol */
-    if((symbol = resolve_symbol(symbols, start)))
+    /* find the symbol, a bare .entry has none */
+    if(*start && (symbol = resolve_symbol(symbols, start)))
     {
         /* set symbol to be an entry */
-        symbol->is_entry = 1;
-        res = SUCCESS;
+        res = set_symbol_entry(symbols, symbol);
     }
     return res;
 }
@@ -122,8 +83,11 @@ int second_pass_process_line(char *line, unsigned int line_number, memory_segmen
     {
         case GUIDE_DATA:
         case GUIDE_STRING:
+        case GUIDE_INCBIN:
+        case GUIDE_INCLUDE:
         case GUIDE_EXTERN:
-            break; /* skip .data .string or .extern guide statements */
+        case GUIDE_SPACE:
+            break; /* skip .data .string .incbin .include .extern or .space guide statements */
 
         case GUIDE_ENTRY:
             res = update_entry(symbols, line);
@@ -134,7 +98,7 @@ int second_pass_process_line(char *line, unsigned int line_number, memory_segmen
             curr = get_memory_item_by_matching_line_number(code_segment, line_number);
             if (curr)
                 /* complete this instruction's encoding */
-                res = complete_instruction_encoding(line, code_segment, curr, symbols, external_symbols);
+                res = complete_instruction_encoding(code_segment, curr, symbols, external_symbols);
             else
                 /* skip instructions we failed to decode in the first pass */
                 res = SUCCESS;
@@ -149,14 +113,15 @@ int second_pass_process_line(char *line, unsigned int line_number, memory_segmen
 /* re-process the file line by line and complete encoding lacking instructions */
 int second_pass(FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, externals_table *external_symbols)
 {
-    char buf[LINE_MAX];
-    char *line = buf;
+    char *buf = NULL;
+    unsigned int buf_size = 0;
+    char *line;
     unsigned line_number = 1;
     int res;
     int number_of_errors = 0;
 
     /* process the line by line */
-    while(fgets((char *)&buf, LINE_MAX, fh))
+    while(read_line(fh, &buf, &buf_size))
     {
         /* skip blank lines and comments */
         if(*(line = skip_whitespaces(buf)) && *line != ';')
@@ -170,6 +135,7 @@ int second_pass(FILE *fh, memory_segment *code_segment, memory_segment *data_seg
         }
         line_number++;
     }
+    free(buf);
     return number_of_errors;
 }
 
@@ -1,5 +1,14 @@
+#ifndef _SECOND_PASS_H
+#define _SECOND_PASS_H
+
+#include <stdio.h>
+
 #include "memory_map.h"
 #include "symbols_table.h"
 #include "externals.h"
 
+int complete_instruction_encoding(memory_segment *code_segment, memory_item *curr, symbol_table *symbols, externals_table *external_symbols);
+int second_pass_process_line(char *line, unsigned int line_number, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, externals_table *external_symbols);
 int second_pass(FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, externals_table *external_symbols);
+
+#endif
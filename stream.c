@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "stream.h"
+#include "first_pass.h"
+#include "second_pass.h"
+#include "utilities.h"
+#include "errors.h"
+#include "archive.h"
+#include "alloc_tracking.h"
+
+/* size of the buffer used to copy the spill files */
+#define SPILL_COPY_BUFFER_SIZE 65536
+
+/*
+ * low memory assembly: the first pass keeps only the symbols and the size of each segment, the second
+ * pass encodes every line again, completes it and writes its words to the spill file of its segment.
+ * the memory used doesn't depend on the size of the program, only on the number of symbols.
+ */
+
+/* create the spill files. returns SUCCESS on success, error code otherwise. */
+int open_spill_files(spill_files *spills)
+{
+    spills->code = tmpfile();
+    spills->data = tmpfile();
+    if(spills->code && spills->data)
+        return SUCCESS;
+    close_spill_files(spills);
+    return ERR_COULD_NOT_OPEN_FILE;
+}
+
+/* close(and delete) the spill files */
+void close_spill_files(spill_files *spills)
+{
+    if(spills->code)
+        fclose(spills->code);
+    if(spills->data)
+        fclose(spills->data);
+    spills->code = spills->data = NULL;
+}
+
+/* drop the words of the item added after last, only the size of the segment is kept */
+void drop_added_memory_item(memory_segment *segment, node *last)
+{
+    node *added = last ? last->next : segment->items.head;
+    memory_item *item;
+
+    if(!added)
+        return;
+
+    item = (memory_item *)added->data;
+    free(item->data);
+    free(item->references);
+    item->data = NULL;
+    item->references = NULL;
+    item->number_of_references = 0;
+
+    /* merge into the previous item so the segment is a single item */
+    if(last)
+    {
+        ((memory_item *)last->data)->size_in_words += item->size_in_words;
+        free(item);
+        free(added);
+        last->next = NULL;
+        segment->items.tail = last;
+    }
+}
+
+/* find the symbols and the size of both segments. returns number of error(lines) found in the file. */
+int stream_first_pass(FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols)
+{
+    char *buf = NULL;
+    unsigned int buf_size = 0;
+    char *line;
+    int res;
+    unsigned line_number = 1;
+    int number_of_errors = 0;
+    node *last_code, *last_data;
+
+    /* read and process one line at a time */
+    while(read_line(fh, &buf, &buf_size))
+    {
+        /* skip blank lines and comments */
+        if(*(line = skip_whitespaces(buf)) && *line != ';')
+        {
+            last_code = code_segment->items.tail;
+            last_data = data_segment->items.tail;
+            res = process_line(line, line_number, code_segment, data_segment, symbols);
+            if(res < 0) /* check for errors */
+            {
+                printf("ERROR! %s [line %d]\r\n", error_code_to_string(res), line_number);
+                number_of_errors++;
+            }
+            drop_added_memory_item(code_segment, last_code);
+            drop_added_memory_item(data_segment, last_data);
+        }
+        line_number++;
+    }
+    free(buf);
+    return number_of_errors;
+}
+
+/* encode each line again, complete it and spill its words. returns number of error(lines) found in the file. */
+int stream_second_pass(FILE *fh, spill_files *spills, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, externals_table *external_symbols)
+{
+    char *buf = NULL, *text = NULL, *tmp;
+    unsigned int buf_size = 0, text_size = 0;
+    char *line;
+    unsigned line_number = 1;
+    unsigned int code_words = 0, data_words = 0;
+    int res;
+    int number_of_errors = 0;
+    memory_segment line_code, line_data;
+    symbol_table line_symbols;
+
+    /* process the line by line */
+    while(read_line(fh, &buf, &buf_size))
+    {
+        /* skip blank lines and comments */
+        if(*(line = skip_whitespaces(buf)) && *line != ';')
+        {
+            /* process_line cuts the label off, keep the line for the second pass */
+            if(text_size < buf_size)
+            {
+                if(!(tmp = realloc(text, buf_size)))
+                {
+                    number_of_errors++;
+                    break;
+                }
+                text = tmp;
+                text_size = buf_size;
+            }
+
+            /* encode the line again at its final address, its errors were reported by the first pass */
+            init_memory_segment(&line_code, code_segment->base_address + code_words);
+            init_memory_segment(&line_data, data_segment->base_address + data_words);
+            init_symbol_table(&line_symbols);
+            process_line(strcpy(text, line), line_number, &line_code, &line_data, &line_symbols);
+
+            res = second_pass_process_line(line, line_number, &line_code, &line_data, symbols, external_symbols);
+            if(res < 0) /* check for errors */
+            {
+                printf("ERROR! %s [line %d]\r\n", error_code_to_string(res), line_number);
+                number_of_errors++;
+            }
+
+            code_words += write_memory_segment(spills->code, &line_code);
+            data_words += write_memory_segment(spills->data, &line_data);
+            free_memory_segment(&line_code);
+            free_memory_segment(&line_data);
+            free_symbols_table(&line_symbols);
+        }
+        line_number++;
+    }
+    free(buf);
+    free(text);
+    return number_of_errors;
+}
+
+/* copy the rest of src to dst. returns SUCCESS on success, error code otherwise. */
+int copy_file(FILE *dst, FILE *src)
+{
+    char buf[SPILL_COPY_BUFFER_SIZE];
+    size_t n;
+
+    while((n = fread(buf, 1, sizeof(buf), src)) > 0)
+    {
+        if(fwrite(buf, 1, n, dst) != n)
+            return ERR_COULD_NOT_OPEN_FILE;
+    }
+    return ferror(src) ? ERR_COULD_NOT_OPEN_FILE : SUCCESS;
+}
+
+/* join the spill files into the object file. returns SUCCESS on success, error code otherwise. */
+int write_streamed_object_file(char *file_path, spill_files *spills, memory_segment *code_segment, memory_segment *data_segment)
+{
+    char name[MAX_FILE_PATH];
+    FILE *fh;
+    int res;
+
+    sprintf(name, "%s.ob", file_path);
+    if(!(fh = open_output_file(name, "w")))
+        return ERR_COULD_NOT_OPEN_FILE;
+
+    fprintf(fh, "%d %d\n", size_of_segment(code_segment), size_of_segment(data_segment));
+    rewind(spills->code);
+    rewind(spills->data);
+    if((res = copy_file(fh, spills->code)) == SUCCESS)
+        res = copy_file(fh, spills->data);
+    if(close_output_file(fh) != 0)
+        res = ERR_COULD_NOT_OPEN_FILE;
+    return res;
+}
@@ -0,0 +1,22 @@
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#include <stdio.h>
+
+#include "memory_map.h"
+#include "symbols_table.h"
+#include "externals.h"
+
+/* encoded words of each segment, in the object file format, until they are joined into the object file */
+typedef struct {
+    FILE *code;
+    FILE *data;
+} spill_files;
+
+int open_spill_files(spill_files *spills);
+void close_spill_files(spill_files *spills);
+int stream_first_pass(FILE *fh, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols);
+int stream_second_pass(FILE *fh, spill_files *spills, memory_segment *code_segment, memory_segment *data_segment, symbol_table *symbols, externals_table *external_symbols);
+int write_streamed_object_file(char *file_path, spill_files *spills, memory_segment *code_segment, memory_segment *data_segment);
+
+#endif
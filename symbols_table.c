@@ -6,22 +6,28 @@
 #include "symbols_table.h"
 #include "utilities.h"
 #include "errors.h"
+#include "archive.h"
+#include "alloc_tracking.h"
 
 /* init a given symbol table */
 void init_symbol_table(symbol_table *table)
 {
-    table->head = NULL;
-    table->tail = NULL;
+    int i;
+    init_list(&table->symbols);
+    init_list(&table->entries);
+    init_list(&table->externals);
+    for(i = 0; i < NUMBER_OF_SEGMENTS; i++)
+        table->base_address[i] = 0;
 }
 
-/* check if this table contains any entries */
+/* check if this table contains any symbols */
 int is_symbols_table_empty(symbol_table *table)
 {
-    return is_empty((list *)table);
+    return is_empty(&table->symbols);
 }
 
-/* add a new symbol to table */
-int add_symbol(symbol_table *table, char *name, unsigned int val, symbol_type type)
+/* add a new symbol to table, at address in the segment of type */
+int add_symbol(symbol_table *table, char *name, unsigned int address, symbol_type type)
 {
     int res = ERR_MEM_ALLOC_FAILED;
     symbol_entry *new_symbol_entry = malloc(sizeof(symbol_entry)); /* allocate heap memory for new item */
@@ -32,13 +38,22 @@ int add_symbol(symbol_table *table, char *name, unsigned int val, symbol_type ty
         {
             /* copy everything */
             strncpy(new_symbol_entry->name, name, MAX_LABEL_LEN); /* we did check the label is valid so its in proper length */
-            new_symbol_entry->val = val;
+            new_symbol_entry->offset = address - table->base_address[type];
             new_symbol_entry->type = type;
             new_symbol_entry->is_entry = 0;
+            new_symbol_entry->line_number = 0;
+            init_list(&new_symbol_entry->usages);
             
             /* insert to memory items list */
-            res = insert((list *)table, new_symbol_entry);
+            res = insert(&table->symbols, new_symbol_entry);
+
+            /* keep externals in their own index too */
+            if(res == SUCCESS && type == external && (res = insert(&table->externals, new_symbol_entry)) != SUCCESS)
+                new_symbol_entry = NULL; /* already owned by the table */
         }
+
+        if(res != SUCCESS)
+            free(new_symbol_entry);
     }
     return res;
 }
@@ -46,7 +61,7 @@ int add_symbol(symbol_table *table, char *name, unsigned int val, symbol_type ty
 /* resolve a symbol from the table by name. returns symbol entry pointer on success, NULL otherwise. */
 symbol_entry *resolve_symbol(symbol_table *table, char *name)
 {
-    node *curr = table->head;
+    node *curr = table->symbols.head;
     while(curr)
     {
         if(!strcmp(((symbol_entry *)curr->data)->name, name))
@@ -58,33 +73,129 @@ symbol_entry *resolve_symbol(symbol_table *table, char *name)
     return NULL;
 }
 
-/* add val to values of all symbols of type. returns number of symbol that were updated */
-int update_symbols_addresses(symbol_table *table, symbol_type type, unsigned int val)
+/* save a line using the symbol as an operand. returns SUCCESS on success, error code otherwise. */
+int add_symbol_usage(symbol_entry *symbol, unsigned int line_number, int addressing_method)
 {
-    int res = 0;
-    node *curr = table->head;
-    while(curr)
+    int res = ERR_MEM_ALLOC_FAILED;
+    symbol_usage *new_usage = malloc(sizeof(symbol_usage));
+    if(new_usage)
     {
-        if(((symbol_entry *)curr->data)->type == type)
-        {
-            ((symbol_entry *)curr->data)->val += val;
-            res++;
-        }
-        curr = curr->next;
+        new_usage->line_number = line_number;
+        new_usage->addressing_method = addressing_method;
+        if((res = insert(&symbol->usages, new_usage)) != SUCCESS)
+            free(new_usage);
     }
     return res;
 }
 
+/* returns the absolute address of symbol, from the base address of its segment */
+unsigned int symbol_address(symbol_table *table, symbol_entry *symbol)
+{
+    return table->base_address[symbol->type] + symbol->offset;
+}
+
+/* move all symbols of type to a new base address, the symbols themselves don't change */
+void set_symbols_base_address(symbol_table *table, symbol_type type, unsigned int base_address)
+{
+    table->base_address[type] = base_address;
+}
+
+/* set symbol to be an entry, once. entries are kept in the order the symbols were defined.
+ * returns SUCCESS on success, error code otherwise. */
+int set_symbol_entry(symbol_table *table, symbol_entry *symbol)
+{
+    node *new_node, **link;
+
+    if(symbol->is_entry)
+        return SUCCESS;
+    if(!(new_node = malloc(sizeof(node))))
+        return ERR_MEM_ALLOC_FAILED;
+    symbol->is_entry = 1;
+    new_node->data = symbol;
+
+    /* usually declared after the entries before it, then it's simply appended */
+    if(!table->entries.tail || ((symbol_entry *)table->entries.tail->data)->line_number <= symbol->line_number)
+        link = table->entries.tail ? &table->entries.tail->next : &table->entries.head;
+    else
+        for(link = &table->entries.head; ((symbol_entry *)(*link)->data)->line_number <= symbol->line_number; link = &(*link)->next);
+
+    new_node->next = *link;
+    *link = new_node;
+    if(!new_node->next)
+        table->entries.tail = new_node;
+    return SUCCESS;
+}
+
+/* move all symbols of type along with the items of their segment. starts has where every item started and the end of
+ * the last one after them, relocation where they start now(as filled by compact_memory_segment) */
+void relocate_symbols(symbol_table *table, symbol_type type, unsigned int base_address, unsigned int *starts, unsigned int number_of_items, unsigned int *relocation)
+{
+    node *curr;
+    symbol_entry *symbol;
+    unsigned int offset, i;
+
+    for(curr = table->symbols.head; curr; curr = curr->next)
+    {
+        if((symbol = (symbol_entry *)curr->data)->type != type)
+            continue;
+        offset = symbol_address(table, symbol) - base_address;
+        i = find_item_index(starts, number_of_items, offset);
+
+        /* a symbol inside an item keeps its place in it, unless the item was removed and has no words left */
+        if(i < number_of_items && relocation[i + 1] != relocation[i])
+            offset = relocation[i] + offset - starts[i];
+        else
+            offset = relocation[i];
+        symbol->offset = base_address + offset - table->base_address[type];
+    }
+}
+
+/* returns the index of the item offset is in, given where every item starts and the end of the last one after them.
+ * the end itself is at index number_of_items */
+unsigned int find_item_index(unsigned int *starts, unsigned int number_of_items, unsigned int offset)
+{
+    unsigned int low = 0, high = number_of_items + 1, middle;
+
+    /* last one that starts at or before the offset */
+    while(high - low > 1)
+    {
+        middle = (low + high) / 2;
+        if(starts[middle] <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/* set marks[i] for every item i a symbol of type starts at(marks[number_of_items] for the end), starts has where every
+ * item starts relative to base_address and the end of the last one after them */
+void mark_symbols_items(char *marks, symbol_table *table, symbol_type type, unsigned int base_address, unsigned int *starts, unsigned int number_of_items)
+{
+    node *curr;
+    unsigned int offset, i;
+
+    memset(marks, 0, number_of_items + 1);
+    for(curr = table->symbols.head; curr; curr = curr->next)
+    {
+        if(((symbol_entry *)curr->data)->type != type)
+            continue;
+        offset = symbol_address(table, (symbol_entry *)curr->data) - base_address;
+        if(starts[i = find_item_index(starts, number_of_items, offset)] == offset)
+            marks[i] = 1;
+    }
+}
+
 /* print a given table */
 void print_symbols_table(symbol_table *table)
 {
-    node *curr = table->head;
+    node *curr = table->symbols.head;
     printf("DEBUG: SYMBOLS TABLE\r\n=======================\r\n");
     while(curr)
     {
         printf("'%s'\t%d\t%d %d\r\n",
                 ((symbol_entry *)curr->data)->name,
-                ((symbol_entry *)curr->data)->val,
+                symbol_address(table, (symbol_entry *)curr->data),
                 ((symbol_entry *)curr->data)->type,
                 ((symbol_entry *)curr->data)->is_entry);
         curr = curr->next;
@@ -93,38 +204,58 @@ void print_symbols_table(symbol_table *table)
 }
 
 
-/* write all the symbols marked as entry to entries file in the format specified in the maman */
+/* write all the symbols marked as entry to entries file in the format specified in the maman. returns number of lines written, -1 on failure */
 int write_entries_file(symbol_table *table, char *file_path)
 {
     char name[MAX_FILE_PATH];
     FILE *fh;
     int number_of_lines_written = -1;
-    node *curr = table->head;
+    node *curr = table->entries.head;
 
     sprintf((char *)&name, "%s.ent", file_path);
-    fh = fopen(name, "w");
+    fh = open_output_file(name, "w");
     if(fh)
     {
-        while(curr)
-        {
-            if (((symbol_entry *)curr->data)->is_entry)
-            {
-                fprintf(fh, "%s %07u\n", ((symbol_entry *)curr->data)->name, ((symbol_entry *)curr->data)->val);
-                number_of_lines_written++;
-            }
-            curr = curr->next;
-        }
-        fclose(fh);
+        for(number_of_lines_written = 0; curr; curr = curr->next, number_of_lines_written++)
+            fprintf(fh, "%s %07u\n", ((symbol_entry *)curr->data)->name, symbol_address(table, (symbol_entry *)curr->data));
+        if(close_output_file(fh) != 0)
+            number_of_lines_written = -1;
     }
     return number_of_lines_written;
 }
 
+/* free the nodes of an index list, the symbols are owned by the symbols list */
+void free_symbols_index(list *index)
+{
+    node *prev_node, *curr_node = index->head;
+    while(curr_node)
+    {
+        prev_node = curr_node;
+        curr_node = curr_node->next;
+        free(prev_node);
+    }
+    init_list(index);
+}
+
 /* free the whole table */
 void free_symbols_table(symbol_table *table)
 {
-    node *prev_node, *curr_node = table->head;
+    node *prev_node, *curr_node = table->symbols.head, *usage_node;
+
+    free_symbols_index(&table->entries);
+    free_symbols_index(&table->externals);
     while(curr_node)
     {
+        /* free the usages */
+        usage_node = ((symbol_entry *)curr_node->data)->usages.head;
+        while(usage_node)
+        {
+            free(usage_node->data);
+            prev_node = usage_node;
+            usage_node = usage_node->next;
+            free(prev_node);
+        }
+
         /* free the data */
         free((symbol_entry *)curr_node->data);
 
@@ -12,19 +12,42 @@ typedef enum {
     external
 } symbol_type;
 
-typedef list symbol_table; /* used encapsulate as specified in the maman */
+
+/* a line using a symbol as an operand, kept only for the cross reference index */
+typedef struct {
+    unsigned int line_number;
+    unsigned char addressing_method;
+} symbol_usage;
 
 typedef struct {
     char name[MAX_LABEL_LEN + 1];
-    unsigned int val;
-    symbol_type type;
+    unsigned int offset; /* from the base address of its segment */
+    symbol_type type; /* also the segment it's in */
     unsigned int is_entry:1;
+    unsigned int line_number; /* where the symbol was defined */
+    list usages;
 } symbol_entry;
 
+/* number of segments symbols can be in, one for each symbol type */
+#define NUMBER_OF_SEGMENTS 3
+
+typedef struct {
+    list symbols; /* all the symbols, in the order they were defined */
+    list entries; /* the symbols declared as entry, in the order declared */
+    list externals; /* the symbols declared as external */
+    unsigned int base_address[NUMBER_OF_SEGMENTS]; /* of each segment, symbols addresses follow it */
+} symbol_table;
+
 void init_symbol_table(symbol_table *table);
-int add_symbol(symbol_table *table, char *name, unsigned int val, symbol_type type);
+int add_symbol(symbol_table *table, char *name, unsigned int address, symbol_type type);
 symbol_entry *resolve_symbol(symbol_table *table, char *name);
-int update_symbols_addresses(symbol_table *table, symbol_type type, unsigned int val);
+unsigned int symbol_address(symbol_table *table, symbol_entry *symbol);
+void set_symbols_base_address(symbol_table *table, symbol_type type, unsigned int base_address);
+int set_symbol_entry(symbol_table *table, symbol_entry *symbol);
+int add_symbol_usage(symbol_entry *symbol, unsigned int line_number, int addressing_method);
+unsigned int find_item_index(unsigned int *starts, unsigned int number_of_items, unsigned int offset);
+void mark_symbols_items(char *marks, symbol_table *table, symbol_type type, unsigned int base_address, unsigned int *starts, unsigned int number_of_items);
+void relocate_symbols(symbol_table *table, symbol_type type, unsigned int base_address, unsigned int *starts, unsigned int number_of_items, unsigned int *relocation);
 int write_entries_file(symbol_table *table, char *file_path);
 int is_symbols_table_empty(symbol_table *table);
 void print_symbols_table();
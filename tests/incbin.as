@@ -0,0 +1,12 @@
+; file incbin.as
+    .entry TABLE
+    .entry PART
+MAIN: lea TABLE, r1
+    prn #7
+    add PART, r2
+    jmp &MAIN
+END: stop
+TABLE: .incbin "tests/incbin.bin"
+PART: .incbin "tests/incbin.bin", 3, 2
+TAIL: .incbin "tests/incbin.bin", 6
+    .data -1
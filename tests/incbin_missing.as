@@ -0,0 +1,5 @@
+; file incbin_missing.as
+MAIN: prn #1
+    stop
+DATA: .incbin "tests/no_such_file.bin"
+    .incbin "tests/incbin.bin", 5, 3
@@ -0,0 +1,11 @@
+; file include.as
+    .entry MAIN
+    .entry NUMBERS
+MAIN: lea MSG, r1
+    jsr PRINT
+    mov NUMBERS, r2
+    cmp r2, #100
+    bne &MAIN
+    stop
+    .include "tests/include.inc"
+COUNT: .data 3
@@ -0,0 +1,5 @@
+; file include_cycle.as
+MAIN: prn #1
+    stop
+    .include "tests/include_cycle.inc"
+    .include "tests/no_such_file.inc"
@@ -0,0 +1,11 @@
+; file space.as
+    .entry BUF
+    .entry FILL
+MAIN: lea BUF, r1
+    mov FILL, r2
+    cmp r2, #-1
+    bne &MAIN
+    stop
+BUF: .space 4
+FILL: .space 3, -1
+LAST: .data 9
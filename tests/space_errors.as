@@ -0,0 +1,7 @@
+; file space_errors.as
+MAIN: prn #1
+    stop
+ZERO: .space 0
+NEG: .space -3
+BIG: .space 8388608
+BAD: .space 2,
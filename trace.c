@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "json.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/*
+ * timeline of the spans and counters of a run, written in the chrome trace event format
+ * (which perfetto and chrome://tracing load). events are kept in memory while tracing and
+ * written once at the end, so recording them is just a timestamp and an append.
+ */
+
+/* initial number of events, doubled whenever it runs out */
+#define TRACE_INITIAL_CAPACITY 256
+
+typedef struct {
+    char phase; /* 'B'egin, 'E'nd or 'C'ounter */
+    char *name; /* never freed, callers pass literals */
+    char *file; /* a copy of the file the span is for, NULL if none */
+    long value; /* of counters */
+    double timestamp; /* in microseconds since tracing started */
+    unsigned int thread_id;
+} trace_record;
+
+typedef struct {
+    pthread_t thread;
+    char *name; /* NULL for unnamed threads */
+} trace_thread;
+
+int tracing = 0;
+
+struct {
+    pthread_mutex_t lock;
+    struct timespec start;
+    trace_record *records;
+    unsigned long number_of_records;
+    unsigned long capacity;
+    trace_thread threads[MAX_TRACE_THREADS];
+    unsigned int number_of_threads;
+} trace;
+
+/* start recording events, the calling thread is the main one. returns SUCCESS on success, error code otherwise */
+int start_trace(void)
+{
+    memset(&trace, 0, sizeof(trace));
+    if(!(trace.records = malloc(TRACE_INITIAL_CAPACITY * sizeof(trace_record))))
+        return ERR_MEM_ALLOC_FAILED;
+    trace.capacity = TRACE_INITIAL_CAPACITY;
+    pthread_mutex_init(&trace.lock, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &trace.start);
+    tracing = 1;
+    trace_thread_name("main");
+    return SUCCESS;
+}
+
+/* returns the id of the calling thread in the trace, adding it if it's new. called locked */
+unsigned int current_thread_id(void)
+{
+    unsigned int i;
+    pthread_t self = pthread_self();
+
+    for(i = 0; i < trace.number_of_threads; i++)
+    {
+        if(pthread_equal(trace.threads[i].thread, self))
+            return i + 1;
+    }
+    if(trace.number_of_threads == MAX_TRACE_THREADS)
+        return MAX_TRACE_THREADS;
+    trace.threads[trace.number_of_threads].thread = self;
+    trace.threads[trace.number_of_threads].name = NULL;
+    return ++trace.number_of_threads;
+}
+
+/* record a single event of the calling thread, events which can't be recorded are dropped */
+void trace_event(char phase, char *name, char *file, long value)
+{
+    struct timespec now;
+    trace_record *record, *tmp;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&trace.lock);
+    if(tracing && trace.number_of_records == trace.capacity)
+    {
+        if((tmp = realloc(trace.records, trace.capacity * 2 * sizeof(trace_record))))
+        {
+            trace.records = tmp;
+            trace.capacity *= 2;
+        }
+    }
+
+    if(tracing && trace.number_of_records < trace.capacity)
+    {
+        record = trace.records + trace.number_of_records++;
+        record->phase = phase;
+        record->name = name;
+        record->value = value;
+        record->timestamp = (now.tv_sec - trace.start.tv_sec) * 1e6 + (now.tv_nsec - trace.start.tv_nsec) / 1e3;
+        record->thread_id = current_thread_id();
+        if(file && (record->file = malloc(strlen(file) + 1)))
+            strcpy(record->file, file);
+        else
+            record->file = NULL;
+    }
+    pthread_mutex_unlock(&trace.lock);
+}
+
+/* name the calling thread on the timeline */
+void trace_thread_name(char *name)
+{
+    if(!tracing)
+        return;
+    pthread_mutex_lock(&trace.lock);
+    trace.threads[current_thread_id() - 1].name = name;
+    pthread_mutex_unlock(&trace.lock);
+}
+
+/* write the recorded events and stop tracing. returns SUCCESS on success, error code otherwise */
+int write_trace_file(char *file_path)
+{
+    FILE *fh;
+    unsigned long i;
+    trace_record *record;
+    int res = ERR_COULD_NOT_OPEN_FILE;
+
+    pthread_mutex_lock(&trace.lock);
+    tracing = 0;
+    pthread_mutex_unlock(&trace.lock);
+
+    if((fh = fopen(file_path, "w")))
+    {
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fh);
+
+        /* name the process and the threads first */
+        fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"assembler\"}}", fh);
+        for(i = 0; i < trace.number_of_threads; i++)
+        {
+            fprintf(fh, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":", i + 1);
+            if(trace.threads[i].name)
+                write_json_string(fh, trace.threads[i].name, strlen(trace.threads[i].name));
+            else
+                fprintf(fh, "\"thread %lu\"", i + 1);
+            fputs("}}", fh);
+        }
+
+        for(i = 0; i < trace.number_of_records; i++)
+        {
+            record = trace.records + i;
+            fputs(",\n{\"name\":", fh);
+            write_json_string(fh, record->name, strlen(record->name));
+            fprintf(fh, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u", record->phase, record->timestamp, record->thread_id);
+            if(record->phase == 'C')
+            {
+                fputs(",\"args\":{", fh);
+                write_json_string(fh, record->name, strlen(record->name));
+                fprintf(fh, ":%ld}", record->value);
+            }
+            else if(record->file)
+            {
+                fputs(",\"args\":{\"file\":", fh);
+                write_json_string(fh, record->file, strlen(record->file));
+                fputc('}', fh);
+            }
+            fputc('}', fh);
+        }
+        fputs("\n]}\n", fh);
+        res = fclose(fh) == 0 ? SUCCESS : ERR_COULD_NOT_OPEN_FILE;
+    }
+
+    for(i = 0; i < trace.number_of_records; i++)
+        free(trace.records[i].file);
+    free(trace.records);
+    trace.records = NULL;
+    trace.number_of_records = 0;
+    return res;
+}
@@ -0,0 +1,19 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+/* most threads named in a single trace, events of any others are all put on the last one */
+#define MAX_TRACE_THREADS 128
+
+/* record a span or a counter, costs a single check when not tracing */
+#define TRACE_BEGIN(name, file) do { if(tracing) trace_event('B', name, file, 0); } while(0)
+#define TRACE_END(name) do { if(tracing) trace_event('E', name, NULL, 0); } while(0)
+#define TRACE_COUNTER(name, value) do { if(tracing) trace_event('C', name, NULL, (long)(value)); } while(0)
+
+extern int tracing;
+
+int start_trace(void);
+void trace_event(char phase, char *name, char *file, long value);
+void trace_thread_name(char *name);
+int write_trace_file(char *file_path);
+
+#endif
@@ -8,11 +8,7 @@
 #include "utilities.h"
 #include "errors.h"
 #include "instructions_table.h"
-
-#define INT21_MIN -1048575
-#define INT21_MAX  1048574
-#define INT24_MIN -8388607
-#define INT24_MAX  8388606
+#include "alloc_tracking.h"
 
 /* returns a pointer the the first non-whitespace char found or null terminator if not found */
 char *skip_whitespaces(char *s)
@@ -52,8 +48,8 @@ char *skip_label(char *str)
     return str;
 }
 
-/* convert ascii string integer to 21-bit data word. returns SUCCESS on success, error code otherwise. */
-int read_int21(char *src, data_word *dst)
+/* convert ascii string integer to 21-bit operand word value. returns SUCCESS on success, error code otherwise. */
+int read_int21(char *src, word *dst)
 {
     int res = ERR_ILLEGAL_CHAR;
     char *end = NULL;
@@ -69,7 +65,7 @@ int read_int21(char *src, data_word *dst)
         /* check that the conversion to 32-bit int worked and also that the result is in 21-bit range */
         if(errno != ERANGE && INT21_MIN <= tmp && tmp <= INT21_MAX)
         {
-            dst->val = tmp;
+            dst->val = ((unsigned long)tmp << OPERAND_VALUE_SHIFT) & WORD_MASK;
             res = SUCCESS;
         }
         else
@@ -108,6 +104,68 @@ int read_int24(char *src, word *dst)
     return res;
 }
 
+/* returns non-zero if all the 4 chars packed in v are decimal digits. checks every byte at once: digits are 0x30-0x39, so
+ * their high nibble is 3 and adding 6 to the low nibble does not carry into it */
+#define ALL_DIGITS4(v) (((v) & 0xf0f0f0f0UL) == 0x30303030UL && (((v) + 0x06060606UL) & 0xf0f0f0f0UL) == 0x30303030UL)
+
+/* read one integer item of a comma separated decimal list(as in .data) into a 24-bit word, scanning up to end.
+ * on success s is moved to the delimiter(comma or end). returns SUCCESS on success, error code otherwise. */
+int read_int24_item(char **s, char *end, word *dst)
+{
+    char *p = skip_whitespaces(*s);
+    unsigned char *digits;
+    unsigned long value = 0, chunk;
+    int negative = 0, overflow = 0;
+
+    /* no value between the delimiters */
+    if(p == end || *p == ',')
+        return ERR_MISSING_VALUE;
+
+    if(*p == '-' || *p == '+')
+        negative = *p++ == '-';
+
+    /* classify and convert 4 digits at a time */
+    for(digits = (unsigned char *)p; end - (char *)digits >= 4; digits += 4)
+    {
+        chunk = (unsigned long)digits[0] | ((unsigned long)digits[1] << 8) | ((unsigned long)digits[2] << 16) | ((unsigned long)digits[3] << 24);
+        if(!ALL_DIGITS4(chunk))
+            break;
+
+        /* combine the digits pairwise: (d0 * 10 + d1, d2 * 10 + d3) and then into a single 4 digits number */
+        chunk -= 0x30303030UL;
+        chunk = ((chunk * 10) + (chunk >> 8)) & 0x00ff00ffUL;
+        chunk = ((chunk * 100) + (chunk >> 16)) & 0xffffUL;
+
+        if(value > -(long)INT24_MIN / 10000)
+            overflow = 1;
+        else
+            value = value * 10000 + chunk;
+    }
+
+    /* and the rest of them one by one */
+    for(; (char *)digits < end && isdigit(*digits); digits++)
+    {
+        if(value > -(long)INT24_MIN / 10)
+            overflow = 1;
+        else
+            value = value * 10 + (*digits - '0');
+    }
+
+    /* make sure we got a number and nothing but whitespaces follows it */
+    if((char *)digits == p)
+        return ERR_ILLEGAL_CHAR;
+    p = skip_whitespaces((char *)digits);
+    if(p != end && *p != ',')
+        return ERR_ILLEGAL_CHAR;
+
+    if(overflow || (negative ? value > -(long)INT24_MIN : value > INT24_MAX))
+        return ERR_INT24_OVERFLOW;
+
+    dst->val = (negative ? -(long)value : (long)value) & WORD_MASK;
+    *s = p;
+    return SUCCESS;
+}
+
 int read_guide_statement_type(char *line)
 {
     int res = ERR_NOT_GUIDE_STATEMENT;
@@ -118,10 +176,16 @@ int read_guide_statement_type(char *line)
             res = GUIDE_DATA;
         else if (STARTS_WITH(line, "string"))
             res = GUIDE_STRING;
+        else if (STARTS_WITH(line, "incbin"))
+            res = GUIDE_INCBIN;
+        else if (STARTS_WITH(line, "include"))
+            res = GUIDE_INCLUDE;
         else if (STARTS_WITH(line, "entry"))
             res = GUIDE_ENTRY;
         else if (STARTS_WITH(line, "extern"))
             res = GUIDE_EXTERN;
+        else if (STARTS_WITH(line, "space"))
+            res = GUIDE_SPACE;
         else
             res = ERR_INVALID_GUIDE;
     }
@@ -165,53 +229,65 @@ unsigned int count_occurrences(char of, char *in)
     return count;
 }
 
-/* convert string to word array. returns size of converted string including null terminator */
-unsigned int chars_to_words(word *dst, char *src)
+/* convert string of given length to word array. returns size of converted string including null terminator */
+unsigned int chars_to_words(word *dst, char *src, unsigned int len)
 {
-    char *curr = src;
-    while(*curr)
+    unsigned int i;
+
+    /* plain counted loop over both arrays so the compiler can widen the chars with vector instructions */
+    for(i = 0; i < len; i++)
+        dst[i].val = src[i];
+    dst[len].val = 0; /* add null terminator */
+    return len + 1;
+}
+
+/* read a whole line, of any length, into a heap buffer which is grown as needed. returns the line or NULL on end of file */
+char *read_line(FILE *fh, char **buf, unsigned int *size)
+{
+    unsigned int len = 0;
+    char *tmp;
+
+    /* allocate the initial buffer on first use */
+    if(!*buf)
     {
-        dst->val = *curr;
-        curr++;
-        dst++;
+        if(!(*buf = malloc(LINE_MAX)))
+            return NULL;
+        *size = LINE_MAX;
     }
-    dst->val = 0; /* add null terminator */
-    return (curr - src) + 1;
+
+    while(fgets(*buf + len, *size - len, fh))
+    {
+        len += strlen(*buf + len);
+
+        /* stop on end of line, or on end of file if fgets did not fill the buffer */
+        if((*buf)[len - 1] == '\n' || len < *size - 1)
+            return *buf;
+
+        /* the line is longer than the buffer, double it and keep reading */
+        if(!(tmp = realloc(*buf, *size * 2)))
+            return *buf;
+        *buf = tmp;
+        *size *= 2;
+    }
+    return len ? *buf : NULL;
 }
 
-void set_flags_absolute(data_word *dst)
+/* set the operand word ARE flags to absolute */
+void set_flags_absolute(word *dst)
 {
-    dst->A = 1;
-    dst->R = 0;
-    dst->E = 0;
+    dst->val = (dst->val & ~(unsigned long)(ARE_A | ARE_R | ARE_E)) | ARE_A;
 }
 
-/* encode direct addressing data word */
-void encode_direct(data_word *dst, symbol_entry *symbol)
+/* encode direct addressing operand word, address is the symbol absolute address */
+void encode_direct(word *dst, symbol_entry *symbol, unsigned int address)
 {
-    dst->val = symbol->val;
-    switch (symbol->type)
-    {
-        case code:
-        case data:
-            dst->A = 0;
-            dst->R = (char)1;
-            dst->E = 0;
-            break;
-        case external:
-            dst->A = 0;
-            dst->R = 0;
-            dst->E = (char)1;
-        default:
-            break;
-    }
+    dst->val = (((unsigned long)address << OPERAND_VALUE_SHIFT) | (symbol->type == external ? ARE_E : ARE_R)) & WORD_MASK;
 }
 
-/* encode relative addressing data word */
-void encode_relative(data_word *dst, symbol_entry *symbol, unsigned int ic)
+/* encode relative addressing operand word */
+void encode_relative(word *dst, unsigned int address, unsigned int ic)
 {
-    dst->val = symbol->val - ic;
-    set_flags_absolute(dst);
+    dst->val = (((unsigned long)(address - ic) << OPERAND_VALUE_SHIFT) | ARE_A) & WORD_MASK;
 }
 
 /* returns OK if label is valid, error code otherwise */
@@ -296,3 +372,93 @@ int split_operands(char *operands_str, char *operand1, char *operand2)
     return res;
 }
 
+/* FNV-1a hash of a null terminated string */
+unsigned long hash_string(char *s)
+{
+    unsigned long hash = 2166136261UL;
+    for(; *s; s++)
+        hash = ((hash ^ (unsigned char)*s) * 16777619UL) & 0xffffffffUL;
+    return hash;
+}
+
+/* FNV-1a hash of the rest of a binary file, from the current position to its end */
+unsigned long hash_stream(FILE *fh)
+{
+    unsigned long hash = 2166136261UL;
+    int c;
+
+    while((c = getc(fh)) != EOF)
+        hash = ((hash ^ (unsigned char)c) * 16777619UL) & 0xffffffffUL;
+    return hash;
+}
+
+/* read a whole text file. returns it null terminated, NULL on failure */
+char *read_text_file(char *file_path)
+{
+    FILE *fh;
+    char *text = NULL;
+    long size;
+
+    if((fh = fopen(file_path, "rb")))
+    {
+        if(fseek(fh, 0, SEEK_END) == 0 && (size = ftell(fh)) >= 0 && fseek(fh, 0, SEEK_SET) == 0 && (text = malloc(size + 1)))
+        {
+            if(fread(text, 1, size, fh) == (size_t)size)
+            {
+                text[size] = '\x0';
+            }
+            else
+            {
+                free(text);
+                text = NULL;
+            }
+        }
+        fclose(fh);
+    }
+    return text;
+}
+
+/* write 32-bit unsigned integer to binary file, least significant byte first */
+void write_u32(FILE *fh, unsigned long val)
+{
+    putc(val & 0xff, fh);
+    putc((val >> 8) & 0xff, fh);
+    putc((val >> 16) & 0xff, fh);
+    putc((val >> 24) & 0xff, fh);
+}
+
+/* read 32-bit unsigned integer written by write_u32 */
+unsigned long read_u32(FILE *fh)
+{
+    unsigned long val;
+    val = (unsigned long)getc(fh) & 0xff;
+    val |= ((unsigned long)getc(fh) & 0xff) << 8;
+    val |= ((unsigned long)getc(fh) & 0xff) << 16;
+    val |= ((unsigned long)getc(fh) & 0xff) << 24;
+    return val;
+}
+
+/* write a string to binary file, prefixed by its length */
+void write_string(FILE *fh, char *s)
+{
+    unsigned long len = strlen(s);
+    write_u32(fh, len);
+    fwrite(s, 1, len, fh);
+}
+
+/* read a string written by write_string into a new heap buffer. returns NULL on failure */
+char *read_string(FILE *fh, unsigned long max_len)
+{
+    unsigned long len = read_u32(fh);
+    char *s;
+
+    if(len > max_len || feof(fh) || !(s = malloc(len + 1)))
+        return NULL;
+    if(fread(s, 1, len, fh) != len)
+    {
+        free(s);
+        return NULL;
+    }
+    s[len] = '\x0';
+    return s;
+}
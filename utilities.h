@@ -1,6 +1,8 @@
 #ifndef _UTILITIES_H
 #define _UTILITIES_H
 
+#include <stdio.h>
+
 #include "memory_map.h"
 #include "symbols_table.h"
 
@@ -10,11 +12,20 @@
 #define LINE_MAX 80 + 3 /* 80 chars + \n (or \r\n) + null terminator */
 #define MAX_FILE_PATH 1024 /* maximum valid file full path */
 
+/* range of the values of immediate operands and of data items */
+#define INT21_MIN -1048575
+#define INT21_MAX  1048574
+#define INT24_MIN -8388607
+#define INT24_MAX  8388606
+
 /* guide types */
 #define GUIDE_DATA 1
 #define GUIDE_STRING 2
 #define GUIDE_ENTRY 3
 #define GUIDE_EXTERN 4
+#define GUIDE_INCBIN 5
+#define GUIDE_INCLUDE 6
+#define GUIDE_SPACE 7
 
 /* addressing methods */
 #define ADDR_IMMEDIATE 0
@@ -25,7 +36,8 @@
 char *skip_whitespaces(char *s);
 unsigned int count_occurrences(char of, char *in);
 
-unsigned int chars_to_words(word *dst, char *src);
+unsigned int chars_to_words(word *dst, char *src, unsigned int len);
+char *read_line(FILE *fh, char **buf, unsigned int *size);
 unsigned int label_len(char *s);
 char *skip_label(char *str);
 int is_valid_label(char *label);
@@ -35,11 +47,20 @@ int split_operands(char *operands_str, char *operand1, char *operand2);
 int read_guide_statement_type(char *line);
 int read_reg_number(char *s);
 int read_addressing_method(char *s);
-int read_int21(char *src, data_word *dst);
+int read_int21(char *src, word *dst);
 int read_int24(char *src, word *dst);
+int read_int24_item(char **s, char *end, word *dst);
+
+unsigned long hash_string(char *s);
+unsigned long hash_stream(FILE *fh);
+char *read_text_file(char *file_path);
+void write_u32(FILE *fh, unsigned long val);
+unsigned long read_u32(FILE *fh);
+void write_string(FILE *fh, char *s);
+char *read_string(FILE *fh, unsigned long max_len);
 
-void set_flags_absolute(data_word *dst);
-void encode_direct(data_word *dst, symbol_entry *symbol);
-void encode_relative(data_word *dst, symbol_entry *symbol, unsigned int ic);
+void set_flags_absolute(word *dst);
+void encode_direct(word *dst, symbol_entry *symbol, unsigned int address);
+void encode_relative(word *dst, unsigned int address, unsigned int ic);
 
 #endif
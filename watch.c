@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+#include "assembler.h"
+#include "utilities.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/* editors either rewrite the file in place or write a new file and rename it over the old one */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+/* enough for a burst of events, every event might carry a name up to NAME_MAX */
+#define EVENTS_BUFFER_SIZE (64 * (sizeof(struct inotify_event) + 256))
+
+typedef struct {
+    char *file_path; /* as given on the command line, without the .as extension */
+    char name[MAX_FILE_PATH]; /* name of the source file inside its directory */
+    int wd; /* watch descriptor of the directory */
+    int changed;
+    struct timespec changed_at; /* time of the first change since the last assembly */
+} watched_file;
+
+/* returns milliseconds passed since given time */
+double ms_since(struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000.0 + (now.tv_nsec - since->tv_nsec) / 1000000.0;
+}
+
+/* watch the directory of the file. returns SUCCESS on success, error code otherwise. */
+int add_watched_file(int fd, watched_file *dst, char *file_path)
+{
+    char dir[MAX_FILE_PATH];
+    char *sep;
+
+    if(strlen(file_path) >= MAX_FILE_PATH - 5)
+        return ERR_COULD_NOT_OPEN_FILE;
+
+    /* split the source path into directory and name */
+    dst->file_path = file_path;
+    if((sep = strrchr(file_path, '/')))
+    {
+        sprintf(dir, "%.*s", (int)(sep - file_path) + 1, file_path);
+        sprintf(dst->name, "%s.as", sep + 1);
+    }
+    else
+    {
+        strcpy(dir, ".");
+        sprintf(dst->name, "%s.as", file_path);
+    }
+    dst->changed = 0;
+
+    /* directories shared by several files get the same watch descriptor */
+    if((dst->wd = inotify_add_watch(fd, dir, WATCH_EVENTS)) < 0)
+        return ERR_COULD_NOT_OPEN_FILE;
+    return SUCCESS;
+}
+
+/* read all the pending events and mark the files they refer to. returns number of events read. */
+int read_events(int fd, watched_file *files, int number_of_files)
+{
+    char buf[EVENTS_BUFFER_SIZE];
+    struct inotify_event *event;
+    ssize_t len;
+    char *curr;
+    int i, number_of_events = 0;
+
+    if((len = read(fd, buf, sizeof(buf))) <= 0)
+        return 0;
+
+    for(curr = buf; curr < buf + len; curr += sizeof(struct inotify_event) + event->len)
+    {
+        event = (struct inotify_event *)curr;
+        number_of_events++;
+        if(!event->len)
+            continue;
+
+        for(i = 0; i < number_of_files; i++)
+        {
+            if(files[i].wd == event->wd && !strcmp(files[i].name, event->name) && !files[i].changed)
+            {
+                files[i].changed = 1;
+                clock_gettime(CLOCK_MONOTONIC, &files[i].changed_at);
+            }
+        }
+    }
+    return number_of_events;
+}
+
+/* keep assembling files whenever they change, never returns unless an error occurred. returns error code. */
+int watch_files(char **file_paths, int number_of_files)
+{
+    int fd, i, res = SUCCESS;
+    struct pollfd pfd;
+    watched_file *files;
+
+    if(!(files = malloc(number_of_files * sizeof(watched_file))))
+        return ERR_MEM_ALLOC_FAILED;
+
+    if((fd = inotify_init()) < 0)
+    {
+        free(files);
+        return ERR_COULD_NOT_OPEN_FILE;
+    }
+
+    for(i = 0; i < number_of_files && res == SUCCESS; i++)
+    {
+        if((res = add_watched_file(fd, files + i, file_paths[i])) != SUCCESS)
+            printf("ERROR! could not watch \"%s\"\n", file_paths[i]);
+    }
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if(res == SUCCESS)
+        puts(">> Watching for changes...");
+
+    while(res == SUCCESS)
+    {
+        /* block until something changes */
+        if(poll(&pfd, 1, -1) < 0 || !read_events(fd, files, number_of_files))
+        {
+            res = ERR_COULD_NOT_OPEN_FILE;
+            break;
+        }
+
+        /* editors usually write in bursts, wait for things to calm down */
+        while(poll(&pfd, 1, WATCH_QUIET_PERIOD_MS) > 0)
+            read_events(fd, files, number_of_files);
+
+        /* reassemble only the files that changed */
+        for(i = 0; i < number_of_files; i++)
+        {
+            if(files[i].changed)
+            {
+                files[i].changed = 0;
+                assemble(files[i].file_path);
+                printf(">> \"%s\" reassembled %.2f ms after change\n", files[i].name, ms_since(&files[i].changed_at));
+            }
+        }
+        fflush(stdout);
+    }
+
+    close(fd);
+    free(files);
+    return res;
+}
@@ -0,0 +1,9 @@
+#ifndef _WATCH_H
+#define _WATCH_H
+
+/* how long to wait for more events after a change before reassembling, in milliseconds */
+#define WATCH_QUIET_PERIOD_MS 50
+
+int watch_files(char **files, int number_of_files);
+
+#endif
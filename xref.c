@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "xref.h"
+#include "utilities.h"
+#include "errors.h"
+#include "alloc_tracking.h"
+
+/*
+ * the cross reference file is binary:
+ * magic, number of symbols, number of buckets, offset of the first record of each bucket(0 for none),
+ * then a record per symbol: offset of the next record in the bucket, name, type, is entry, address,
+ * line of definition, number of usages and the usages themselves(line, addressing method).
+ * a single symbol is looked up by hashing its name and walking its bucket.
+ */
+
+/* number of buckets for the symbols, the smallest power of 2 not smaller than the number of symbols */
+unsigned long xref_number_of_buckets(unsigned long number_of_symbols)
+{
+    unsigned long n = 1;
+    while(n < number_of_symbols)
+        n <<= 1;
+    return n;
+}
+
+/* write a single symbol record, chaining it to the head of its bucket */
+void write_xref_record(FILE *fh, symbol_table *symbols, symbol_entry *symbol, unsigned long *buckets, unsigned long number_of_buckets)
+{
+    unsigned long bucket = hash_string(symbol->name) & (number_of_buckets - 1), number_of_usages = 0;
+    node *curr;
+
+    for(curr = symbol->usages.head; curr; curr = curr->next)
+        number_of_usages++;
+
+    write_u32(fh, buckets[bucket]);
+    buckets[bucket] = ftell(fh) - 4;
+    write_string(fh, symbol->name);
+    putc(symbol->type, fh);
+    putc(symbol->is_entry, fh);
+    write_u32(fh, symbol_address(symbols, symbol));
+    write_u32(fh, symbol->line_number);
+    write_u32(fh, number_of_usages);
+    for(curr = symbol->usages.head; curr; curr = curr->next)
+    {
+        write_u32(fh, ((symbol_usage *)curr->data)->line_number);
+        putc(((symbol_usage *)curr->data)->addressing_method, fh);
+    }
+}
+
+/* write the cross reference of all symbols to file. returns SUCCESS on success, error code otherwise. */
+int write_xref_file(char *file_path, symbol_table *symbols)
+{
+    char name[MAX_FILE_PATH];
+    FILE *fh;
+    unsigned long i, number_of_symbols = 0, number_of_buckets, *buckets;
+    node *curr;
+    int res = ERR_MEM_ALLOC_FAILED;
+
+    for(curr = symbols->symbols.head; curr; curr = curr->next)
+        number_of_symbols++;
+    number_of_buckets = xref_number_of_buckets(number_of_symbols);
+    if(!(buckets = calloc(number_of_buckets, sizeof(unsigned long))))
+        return res;
+
+    sprintf(name, "%s.xref", file_path);
+    if((fh = fopen(name, "wb")))
+    {
+        /* the bucket heads are known only after writing the records, leave room for them */
+        write_u32(fh, XREF_FILE_MAGIC);
+        write_u32(fh, number_of_symbols);
+        write_u32(fh, number_of_buckets);
+        for(i = 0; i < number_of_buckets; i++)
+            write_u32(fh, 0);
+
+        for(curr = symbols->symbols.head; curr; curr = curr->next)
+            write_xref_record(fh, symbols, (symbol_entry *)curr->data, buckets, number_of_buckets);
+
+        fseek(fh, 12, SEEK_SET);
+        for(i = 0; i < number_of_buckets; i++)
+            write_u32(fh, buckets[i]);
+        res = ferror(fh) ? ERR_COULD_NOT_OPEN_FILE : SUCCESS;
+        fclose(fh);
+    }
+    else
+    {
+        res = ERR_COULD_NOT_OPEN_FILE;
+    }
+    free(buckets);
+    return res;
+}
+
+/* read a symbol record and print it if it's symbol_name(or any symbol for NULL).
+ * returns SUCCESS if printed, ERR_MISSING_SYMBOL if skipped, error code otherwise. */
+int print_xref_record(FILE *fh, char *symbol_name)
+{
+    static char *type_names[] = {"code", "data", "external"};
+    static char *method_names[] = {"immediate", "direct", "relative", "register"};
+    unsigned long i, number_of_usages, line_number, address, definition_line;
+    unsigned int type, is_entry, method;
+    int res = ERR_MISSING_SYMBOL;
+    char *name;
+
+    if(!(name = read_string(fh, MAX_LABEL_LEN)))
+        return ERR_INVALID_VALUE;
+    type = getc(fh);
+    is_entry = getc(fh);
+    address = read_u32(fh);
+    definition_line = read_u32(fh);
+    number_of_usages = read_u32(fh);
+
+    /* only the symbol asked for, if any */
+    if(!symbol_name || !strcmp(name, symbol_name))
+    {
+        printf("%s %s%s %07lu", name, type <= external ? type_names[type] : "?", is_entry ? " entry" : "", address);
+        if(type != external)
+            printf(" defined at line %lu", definition_line);
+        printf(", %lu usage%s", number_of_usages, number_of_usages == 1 ? "" : "s");
+        for(i = 0; i < number_of_usages && !feof(fh); i++)
+        {
+            line_number = read_u32(fh);
+            method = getc(fh);
+            printf("%s line %lu(%s)", i ? "," : ":", line_number, method <= ADDR_REG_DIRECT ? method_names[method] : "?");
+        }
+        putchar('\n');
+        res = SUCCESS;
+    }
+    free(name);
+    return feof(fh) ? ERR_INVALID_VALUE : res;
+}
+
+/* print the cross reference file, all of it or only symbol_name if not NULL. returns SUCCESS on success, error code otherwise. */
+int dump_xref_file(char *xref_path, char *symbol_name)
+{
+    FILE *fh;
+    unsigned long i, number_of_symbols, number_of_buckets, offset;
+    int res = ERR_INVALID_VALUE;
+
+    if(!(fh = fopen(xref_path, "rb")))
+        return ERR_COULD_NOT_OPEN_FILE;
+
+    if(read_u32(fh) == XREF_FILE_MAGIC)
+    {
+        number_of_symbols = read_u32(fh);
+        number_of_buckets = read_u32(fh);
+        if(number_of_buckets && !(number_of_buckets & (number_of_buckets - 1)) && !feof(fh))
+        {
+            if(symbol_name)
+            {
+                /* walk only the bucket of the symbol */
+                fseek(fh, 12 + 4 * (hash_string(symbol_name) & (number_of_buckets - 1)), SEEK_SET);
+                for(offset = read_u32(fh), res = ERR_MISSING_SYMBOL; offset && res == ERR_MISSING_SYMBOL; )
+                {
+                    fseek(fh, offset, SEEK_SET);
+                    offset = read_u32(fh);
+                    res = print_xref_record(fh, symbol_name);
+                }
+            }
+            else
+            {
+                /* the records follow the buckets */
+                fseek(fh, 12 + 4 * number_of_buckets, SEEK_SET);
+                for(res = SUCCESS, i = 0; i < number_of_symbols && res == SUCCESS; i++)
+                {
+                    read_u32(fh);
+                    res = print_xref_record(fh, NULL);
+                }
+            }
+        }
+    }
+    fclose(fh);
+    return res;
+}
@@ -0,0 +1,12 @@
+#ifndef _XREF_H
+#define _XREF_H
+
+#include "symbols_table.h"
+
+/* magic number at the start of the cross reference file("XRF1") */
+#define XREF_FILE_MAGIC 0x31465258UL
+
+int write_xref_file(char *file_path, symbol_table *symbols);
+int dump_xref_file(char *xref_path, char *symbol_name);
+
+#endif